@@ -29,8 +29,7 @@ limitations under the License.
 #include "itkDiffusionTensor3D.h"
 #include "itkHessianRecursiveGaussianImageFilter.h"
 #include "itkStructureTensorRecursiveGaussianImageFilter.h"
-#include "itkSymmetricEigenAnalysisImageFilter.h"
-#include "itkSymmetricEigenVectorAnalysisImageFilter.h"
+#include "itkSymmetricEigenSystemAnalysisImageFilter.h"
 
 namespace itk {
 /** \class AnisotropicCoherenceEnhancingDiffusionImageFilter
@@ -47,16 +46,18 @@ namespace itk {
  */
 
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage,
+          class TTensorValueType = double>
 class ITK_EXPORT AnisotropicCoherenceEnhancingDiffusionImageFilter  
-  : public AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+  : public AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage,
+                                                 TTensorValueType>
 {
 public:
   /** Standard class typedefs */
   typedef AnisotropicCoherenceEnhancingDiffusionImageFilter Self;
 
-  typedef AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage> 
-                                                           Superclass;
+  typedef AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage,
+                                                TTensorValueType> Superclass;
 
   typedef SmartPointer<Self>                               Pointer;
   typedef SmartPointer<const Self>                         ConstPointer;
@@ -77,27 +78,39 @@ public:
   typedef typename Superclass::DiffusionTensorImageType
                                                 DiffusionTensorImageType;
 
-  // Structure tensor type 
-  typedef StructureTensorRecursiveGaussianImageFilter < InputImageType >
-                                                StructureTensorFilterType;
- 
+  /** Type of the diffusion tensor components */
+  typedef typename Superclass::TensorValueType  TensorValueType;
+
+  typedef typename Superclass::DiffusionTensorComponentImageType
+                                          DiffusionTensorComponentImageType;
+
   /** Dimensionality of input and output data is assumed to be the same.
    * It is inherited from the superclass. */
   itkStaticConstMacro(ImageDimension, unsigned int,Superclass::ImageDimension);
+  itkStaticConstMacro(NumberOfDiffusionTensorComponents, unsigned int,
+                      Superclass::NumberOfDiffusionTensorComponents);
 
-  typedef itk::Matrix<double, ImageDimension, ImageDimension> MatrixType;
+  typedef itk::Matrix<TensorValueType, ImageDimension, ImageDimension>
+                                                         MatrixType;
 
   // Define image of matrix pixel type 
   typedef itk::Image< MatrixType, ImageDimension>  OutputMatrixImageType;
 
   // Define the symmetric tensor pixel type
-  typedef itk::SymmetricSecondRankTensor< double, ImageDimension> 
+  typedef itk::SymmetricSecondRankTensor< TensorValueType, ImageDimension> 
                                                          TensorPixelType;
   typedef itk::Image< TensorPixelType, ImageDimension>  
                                                          TensorImageType;
 
+  // Structure tensor type. It is computed from the output, which changes
+  // at each iteration.
+  typedef StructureTensorRecursiveGaussianImageFilter < OutputImageType,
+                                                        TensorImageType >
+                                                StructureTensorFilterType;
+
    // Define the type for storing the eigen-value
-  typedef itk::FixedArray< double, ImageDimension >      EigenValueArrayType;
+  typedef itk::FixedArray< TensorValueType, ImageDimension >
+                                                         EigenValueArrayType;
   
   // Declare the types of the output images
   typedef itk::Image< EigenValueArrayType, ImageDimension >  
@@ -110,6 +123,15 @@ public:
   typedef typename Superclass::DiffusionTensorNeighborhoodType
                                                DiffusionTensorNeighborhoodType;
 
+  /** Types of the eigen system of the structure tensor. The eigen vectors
+   * are the rows of the eigen vector matrix. */
+  typedef MatrixType                               EigenVectorMatrixType;
+  typedef OutputMatrixImageType                    EigenVectorImageType;
+  typedef EigenAnalysisOutputImageType             EigenValueImageType;
+  typedef SymmetricEigenSystemAnalysisImageFilter<
+    typename StructureTensorFilterType::OutputImageType,
+    EigenValueImageType, EigenVectorImageType >    EigenSystemAnalysisFilterType;
+
   /** Set the contrast parameter */
   void SetContrastParameterLambdaC( double value ); 
 
@@ -126,6 +148,22 @@ protected:
 
   /** Update diffusion tensor image */
   void virtual UpdateDiffusionTensorImage();
+
+  /** Extent of the structure tensor kernels */
+  virtual unsigned long GetDiffusionTensorRadius() const;
+
+  /** Add the images of the structure tensor pipeline */
+  virtual double GetNumberOfBytesPerPixel() const;
+
+  typedef typename Superclass::ThreadDiffusionTensorImageRegionType
+                                        ThreadDiffusionTensorImageRegionType;
+
+  /** Build the diffusion tensors of a region from the eigen system of the
+   * structure tensor */
+  virtual
+  void ThreadedGenerateDiffusionTensorImage(
+               const ThreadDiffusionTensorImageRegionType &diffusionRegionToProcess,
+               int threadId);
  
 private:
   //purposely not implemented
@@ -135,6 +173,14 @@ private:
   double     m_ContrastParameterLambdaC;
   double     m_Alpha;
   double     m_Sigma;
+
+  /** Structure tensor mini-pipeline. It is created once and its buffers
+   * are reused by every iteration. */
+  typename StructureTensorFilterType::Pointer      m_StructureTensorFilter;
+  typename EigenSystemAnalysisFilterType::Pointer  m_EigenSystemAnalysisFilter;
+
+  typename EigenValueImageType::Pointer         m_EigenValueImage;
+  typename EigenVectorImageType::Pointer        m_EigenVectorImage;
 };
   
 
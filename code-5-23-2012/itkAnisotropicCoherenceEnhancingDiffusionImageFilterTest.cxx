@@ -31,19 +31,29 @@ int main(int argc, char* argv [] )
               << argv[0]
               << " Input_Image"
               << " Edge_Enhanced_Output_Image [Sigma] [Alpha] [ContrastParameter]"
-              << "[TimeStep] [NumberOfIterations]" << std::endl; 
+              << "[TimeStep] [NumberOfIterations] [DiffusionTensorUpdateInterval]"
+              << std::endl; 
     return EXIT_FAILURE;
     }
  
  
   // Define the dimension of the images
   const unsigned int Dimension = 3;
-  typedef double      InputPixelType;
+
+  // The CT input is kept in its 16 bit pixel type; the filter converts it
+  // to the output pixel type
+  typedef short       InputPixelType;
+#ifdef USE_FLOAT_PRECISION
+  typedef float       OutputPixelType;
+  typedef float       TensorValueType;
+#else
   typedef double      OutputPixelType;
+  typedef double      TensorValueType;
+#endif
 
   // Declare the types of the images
   typedef itk::Image< InputPixelType, Dimension>           InputImageType;
-  typedef itk::Image< InputPixelType, Dimension>           OutputImageType;
+  typedef itk::Image< OutputPixelType, Dimension>          OutputImageType;
 
   typedef itk::ImageFileReader< InputImageType  >      ImageReaderType;
 
@@ -64,7 +74,8 @@ int main(int argc, char* argv [] )
 
   // Declare the anisotropic diffusion edge enhancement filter
   typedef itk::AnisotropicCoherenceEnhancingDiffusionImageFilter< InputImageType,
-                                            OutputImageType>  CoherenceEnhancingFilterType;
+                                            OutputImageType,
+                                            TensorValueType>  CoherenceEnhancingFilterType;
 
   // Create a edge enhancement Filter
   CoherenceEnhancingFilterType::Pointer CoherenceEnhancingFilter = 
@@ -114,6 +125,13 @@ int main(int argc, char* argv [] )
     CoherenceEnhancingFilter->SetNumberOfIterations( numberOfIterations );
     } 
 
+  //Set the number of iterations between two diffusion tensor updates
+  if( argc > 8 ) 
+    {
+    unsigned int interval = atoi(argv[8]);
+    CoherenceEnhancingFilter->SetDiffusionTensorUpdateInterval( interval );
+    } 
+
   CoherenceEnhancingFilter->Print ( std::cout );
   std::cout << "Enhancing .........: " << argv[1] << std::endl;
 
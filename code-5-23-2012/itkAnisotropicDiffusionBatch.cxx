@@ -0,0 +1,351 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkAnisotropicDiffusionBatch.cxx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+
+// Runs the diffusion filters on many volumes listed in a manifest. Each
+// line of the manifest is one job:
+//
+//   Filter Input_Image Output_Image [parameter=value ...]
+//
+// Filter is EED, CED or Hybrid. Empty lines and lines that start with #
+// are skipped. The parameters are
+//
+//   all filters: sigma timestep iterations interval semiimplicit rms
+//   EED:         lambdae
+//   CED:         alpha lambdac
+//   Hybrid:      alpha lambdaeed lambdaced lambdahybrid
+//
+// The next volume is read and the previous one written on two background
+// threads while the current one is filtered. All the filters share one
+// pool of worker threads, which is started once for the whole batch. A job
+// that fails is reported and the batch goes on with the next one.
+
+#include "itkAnisotropicEdgeEnhancementDiffusionImageFilter.h"
+#include "itkAnisotropicCoherenceEnhancingDiffusionImageFilter.h"
+#include "itkAnisotropicHybridDiffusionImageFilter.h"
+#include "itkPersistentThreadPool.h"
+#include "itkAsynchronousImageFileReader.h"
+#include "itkAsynchronousImageFileWriter.h"
+#include "itkObjectFactoryBase.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+const unsigned int Dimension = 3;
+#ifdef USE_FLOAT_PRECISION
+typedef float       PixelType;
+typedef float       TensorValueType;
+#else
+typedef double      PixelType;
+typedef double      TensorValueType;
+#endif
+
+typedef itk::Image< PixelType, Dimension>           ImageType;
+
+typedef itk::AnisotropicDiffusionTensorImageFilter< ImageType, ImageType,
+                                     TensorValueType >  DiffusionFilterType;
+typedef itk::AnisotropicEdgeEnhancementDiffusionImageFilter< ImageType,
+                                     ImageType, TensorValueType >  EEDFilterType;
+typedef itk::AnisotropicCoherenceEnhancingDiffusionImageFilter< ImageType,
+                                     ImageType, TensorValueType >  CEDFilterType;
+typedef itk::AnisotropicHybridDiffusionImageFilter< ImageType,
+                                     ImageType, TensorValueType >  HybridFilterType;
+
+typedef itk::AsynchronousImageFileReader< ImageType >  ReaderType;
+typedef itk::AsynchronousImageFileWriter< ImageType >  WriterType;
+
+struct Job
+  {
+  unsigned int                   Line;
+  std::string                    Filter;
+  std::string                    Input;
+  std::string                    Output;
+  std::map<std::string, double>  Parameters;
+  std::string                    Error;
+  };
+
+// Remove a parameter from the job. Returns false when it is not given.
+bool TakeParameter( Job & job, const char * name, double & value )
+{
+  std::map<std::string, double>::iterator it = job.Parameters.find( name );
+  if ( it == job.Parameters.end() )
+    {
+    return false;
+    }
+  value = it->second;
+  job.Parameters.erase( it );
+  return true;
+}
+
+// Take a count parameter of the job. Returns false and sets the error of
+// the job when the value is negative or not a whole number.
+bool TakeCount( Job & job, const char * name, bool & found,
+                unsigned int & count )
+{
+  double value;
+  found = TakeParameter( job, name, value );
+  if ( found )
+    {
+    if ( value < 0.0 || value != std::floor( value ) )
+      {
+      std::ostringstream error;
+      error << "Invalid " << name << " count " << value;
+      job.Error = error.str();
+      return false;
+      }
+    count = static_cast<unsigned int>( value );
+    }
+  return true;
+}
+
+// Create the filter of a job and set its parameters. Returns 0 and sets
+// the error of the job when the job is not valid.
+DiffusionFilterType::Pointer CreateFilter( Job & job )
+{
+  DiffusionFilterType::Pointer filter;
+  double value;
+
+  if ( job.Filter == "EED" )
+    {
+    EEDFilterType::Pointer eed = EEDFilterType::New();
+    if ( TakeParameter( job, "sigma", value ) ) { eed->SetSigma( value ); }
+    if ( TakeParameter( job, "lambdae", value ) ) { eed->SetContrastParameterLambdaE( value ); }
+    filter = eed.GetPointer();
+    }
+  else if ( job.Filter == "CED" )
+    {
+    CEDFilterType::Pointer ced = CEDFilterType::New();
+    if ( TakeParameter( job, "sigma", value ) ) { ced->SetSigma( value ); }
+    if ( TakeParameter( job, "alpha", value ) ) { ced->SetAlpha( value ); }
+    if ( TakeParameter( job, "lambdac", value ) ) { ced->SetContrastParameterLambdaC( value ); }
+    filter = ced.GetPointer();
+    }
+  else if ( job.Filter == "Hybrid" )
+    {
+    HybridFilterType::Pointer hybrid = HybridFilterType::New();
+    if ( TakeParameter( job, "sigma", value ) ) { hybrid->SetSigma( value ); }
+    if ( TakeParameter( job, "alpha", value ) ) { hybrid->SetAlpha( value ); }
+    if ( TakeParameter( job, "lambdaeed", value ) ) { hybrid->SetContrastParameterLambdaEED( value ); }
+    if ( TakeParameter( job, "lambdaced", value ) ) { hybrid->SetContrastParameterLambdaCED( value ); }
+    if ( TakeParameter( job, "lambdahybrid", value ) ) { hybrid->SetContrastParameterLambdaHybrid( value ); }
+    filter = hybrid.GetPointer();
+    }
+  else
+    {
+    job.Error = "Unknown filter " + job.Filter;
+    return 0;
+    }
+
+  if ( TakeParameter( job, "timestep", value ) ) { filter->SetTimeStep( value ); }
+  bool found;
+  unsigned int count;
+  if ( !TakeCount( job, "iterations", found, count ) )
+    {
+    return 0;
+    }
+  if ( found ) { filter->SetNumberOfIterations( count ); }
+  if ( !TakeCount( job, "interval", found, count ) )
+    {
+    return 0;
+    }
+  if ( found ) { filter->SetDiffusionTensorUpdateInterval( count ); }
+  if ( TakeParameter( job, "semiimplicit", value ) )
+    {
+    filter->SetUseSemiImplicitScheme( value != 0.0 );
+    }
+  if ( TakeParameter( job, "rms", value ) ) { filter->SetMaximumRMSError( value ); }
+
+  if ( !job.Parameters.empty() )
+    {
+    job.Error = "Unknown parameter " + job.Parameters.begin()->first;
+    return 0;
+    }
+
+  return filter;
+}
+
+// Read the manifest. Returns false when it cannot be opened. A job that
+// writes the output image of an earlier line is not valid.
+bool ReadManifest( const char * fileName, std::vector<Job> & jobs )
+{
+  std::ifstream manifest( fileName );
+  if ( !manifest )
+    {
+    return false;
+    }
+
+  std::map<std::string, unsigned int> lineOfOutput;
+  std::string line;
+  unsigned int lineNumber = 0;
+  while ( std::getline( manifest, line ) )
+    {
+    lineNumber++;
+    std::istringstream fields( line );
+    Job job;
+    job.Line = lineNumber;
+    if ( !( fields >> job.Filter ) || job.Filter[0] == '#' )
+      {
+      continue;
+      }
+    if ( !( fields >> job.Input >> job.Output ) )
+      {
+      job.Error = "Missing input or output image";
+      }
+    else if ( lineOfOutput.count( job.Output ) )
+      {
+      std::ostringstream error;
+      error << "Output image " << job.Output << " is also written by line "
+            << lineOfOutput[ job.Output ];
+      job.Error = error.str();
+      }
+    else
+      {
+      lineOfOutput[ job.Output ] = lineNumber;
+      }
+
+    std::string parameter;
+    while ( fields >> parameter )
+      {
+      const std::string::size_type equal = parameter.find( '=' );
+      if ( equal == std::string::npos )
+        {
+        job.Error = "Parameter without value: " + parameter;
+        break;
+        }
+      const std::string text = parameter.substr( equal + 1 );
+      char * end;
+      const double value = strtod( text.c_str(), &end );
+      if ( text.empty() || *end != '\0' )
+        {
+        job.Error = "Invalid parameter value: " + parameter;
+        break;
+        }
+      job.Parameters[ parameter.substr( 0, equal ) ] = value;
+      }
+    jobs.push_back( job );
+    }
+
+  return true;
+}
+}
+
+int main(int argc, char* argv [] )
+{
+  if ( argc < 2 )
+    {
+    std::cerr << "Missing Parameters: " 
+              << argv[0]
+              << " Manifest [NumberOfThreads]"
+              << std::endl; 
+    return EXIT_FAILURE;
+    }
+
+  std::vector<Job> jobs;
+  if ( !ReadManifest( argv[1], jobs ) )
+    {
+    std::cerr << "Cannot read the manifest " << argv[1] << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const int numberOfThreads = ( argc > 2 ) ? atoi( argv[2] )
+    : itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+
+  // Register the image IO factories before the reader and the writer
+  // threads look them up
+  itk::ObjectFactoryBase::GetRegisteredFactories();
+
+  // One set of workers for all the filters of the batch
+  itk::PersistentThreadPool::Pointer threadPool = itk::PersistentThreadPool::New();
+  threadPool->Start( numberOfThreads );
+
+  // At most one volume is read ahead and one waits to be written
+  ReaderType::Pointer reader = ReaderType::New();
+  WriterType::Pointer writer = WriterType::New();
+  for ( unsigned int j = 0; j < jobs.size(); j++ )
+    {
+    if ( jobs[j].Error.empty() )
+      {
+      reader->Prefetch( jobs[j].Input );
+      }
+    }
+
+  std::map<std::string, Job *> jobOfOutput;
+  for ( unsigned int j = 0; j < jobs.size(); j++ )
+    {
+    Job & job = jobs[j];
+    if ( !job.Error.empty() )
+      {
+      continue;
+      }
+    try
+      {
+      // Take the image even when the job is not valid to keep the
+      // prefetched images in step with the jobs
+      ImageType::Pointer image = reader->GetNextImage();
+      DiffusionFilterType::Pointer filter = CreateFilter( job );
+      if ( filter )
+        {
+        std::cout << "Enhancing .........: " << job.Input << std::endl;
+        filter->SetThreadPool( threadPool );
+        filter->SetNumberOfThreads( threadPool->GetNumberOfThreads() );
+        filter->SetInput( image );
+        filter->Update();
+        image = filter->GetOutput();
+        image->DisconnectPipeline();
+
+        jobOfOutput[ job.Output ] = &job;
+        writer->Write( image, job.Output );
+        }
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      job.Error = err.GetDescription();
+      }
+    }
+
+  const WriterType::FailureListType failures = writer->Flush();
+  for ( unsigned int f = 0; f < failures.size(); f++ )
+    {
+    jobOfOutput[ failures[f].FileName ]->Error = failures[f].Error;
+    }
+
+  threadPool->Stop();
+
+  // Report the jobs that failed
+  unsigned int numberOfFailures = 0;
+  for ( unsigned int j = 0; j < jobs.size(); j++ )
+    {
+    if ( !jobs[j].Error.empty() )
+      {
+      std::cerr << argv[1] << ":" << jobs[j].Line << ": " << jobs[j].Error
+                << std::endl;
+      numberOfFailures++;
+      }
+    }
+  std::cout << jobs.size() - numberOfFailures << " of " << jobs.size()
+            << " jobs done" << std::endl;
+
+  return numberOfFailures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,367 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkAnisotropicDiffusionStageBenchmark.cxx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+
+// Times each stage of the edge enhancement diffusion separately on
+// synthetic cubes of 64^3 voxels up to MaxSize^3, with 1, 2, 4, ... threads.
+// Each line of the output is
+//
+//   stage  size  threads  seconds  voxels/s  speed-up
+//
+// separated by tabs, where seconds is the best of the repetitions and the
+// speed-up is relative to one thread. The lines are always in the same
+// order, so the output of two builds can be compared with diff or a
+// spreadsheet. 512^3 double precision voxels need about 40 GB of memory.
+
+#include "itkAnisotropicEdgeEnhancementDiffusionImageFilter.h"
+#include "itkStructureTensorRecursiveGaussianImageFilter.h"
+#include "itkSymmetricEigenSystemAnalysisImageFilter.h"
+#include "itkSymmetricEigenVectorAnalysisImageFilter.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMultiThreader.h"
+#include "itkTimeProbe.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+/** Edge enhancement filter that makes the stages of an iteration public so
+ * they can be timed one by one. */
+template <class TImage, class TTensorValueType>
+class StageBenchmarkEdgeEnhancementDiffusionImageFilter
+  : public AnisotropicEdgeEnhancementDiffusionImageFilter<TImage, TImage,
+                                                          TTensorValueType>
+{
+public:
+  typedef StageBenchmarkEdgeEnhancementDiffusionImageFilter     Self;
+  typedef AnisotropicEdgeEnhancementDiffusionImageFilter<TImage, TImage,
+                                           TTensorValueType>    Superclass;
+  typedef SmartPointer<Self>                                    Pointer;
+  typedef typename Superclass::TimeStepType                     TimeStepType;
+
+  itkNewMacro( Self );
+
+  void RunUpdateDiffusionTensorImage()
+    { this->UpdateDiffusionTensorImage(); }
+
+  void RunGenerateDiffusionTensorImage()
+    { this->GenerateDiffusionTensorImage(); }
+
+  TimeStepType RunCalculateChange()
+    { return this->CalculateChange(); }
+
+  void RunApplyUpdate( TimeStepType dt )
+    { this->ApplyUpdate( dt ); }
+
+protected:
+  StageBenchmarkEdgeEnhancementDiffusionImageFilter() {}
+};
+}
+
+namespace
+{
+struct Timing
+  {
+  std::string Stage;
+  unsigned int Size;
+  int Threads;
+  double Seconds;
+  };
+
+// Best time of the repetitions
+template <class TFunction>
+double TimeStage( TFunction function, unsigned int numberOfRepetitions )
+{
+  double best = 0.0;
+  for ( unsigned int rep = 0; rep < numberOfRepetitions; rep++ )
+    {
+    itk::TimeProbe probe;
+    probe.Start();
+    function();
+    probe.Stop();
+    if ( rep == 0 || probe.GetMeanTime() < best )
+      {
+      best = probe.GetMeanTime();
+      }
+    }
+  return best;
+}
+
+template <class TFilter>
+struct UpdateFunction
+  {
+  TFilter * Filter;
+  void operator()() const
+    {
+    this->Filter->Modified();
+    this->Filter->Update();
+    }
+  };
+
+template <class TFilter>
+UpdateFunction<TFilter> MakeUpdateFunction( TFilter * filter )
+{
+  UpdateFunction<TFilter> function;
+  function.Filter = filter;
+  return function;
+}
+
+template <class TFilter>
+struct DiffusionTensorImageFunction
+  {
+  TFilter * Filter;
+  bool      Assembly;
+  void operator()() const
+    {
+    if ( this->Assembly )
+      {
+      this->Filter->RunGenerateDiffusionTensorImage();
+      }
+    else
+      {
+      this->Filter->RunUpdateDiffusionTensorImage();
+      }
+    }
+  };
+
+template <class TFilter>
+struct CalculateChangeFunction
+  {
+  TFilter * Filter;
+  void operator()() const
+    {
+    this->Filter->RunCalculateChange();
+    }
+  };
+
+template <class TFilter>
+struct ApplyUpdateFunction
+  {
+  TFilter * Filter;
+  void operator()() const
+    {
+    this->Filter->RunApplyUpdate( 0.01 );
+    }
+  };
+}
+
+int main(int argc, char* argv [] )
+{
+  if ( argc > 1 && argv[1][0] == '-' )
+    {
+    std::cerr << "Usage: " 
+              << argv[0]
+              << " [MaxSize] [MaxNumberOfThreads] [NumberOfRepetitions]"
+              << std::endl; 
+    return EXIT_FAILURE;
+    }
+
+  const unsigned int maxSize = ( argc > 1 ) ? atoi(argv[1]) : 512;
+  const int maxNumberOfThreads = ( argc > 2 ) ? atoi(argv[2])
+    : itk::MultiThreader::GetGlobalDefaultNumberOfThreads();
+  const unsigned int numberOfRepetitions = ( argc > 3 ) ? atoi(argv[3]) : 3;
+
+  const unsigned int Dimension = 3;
+#ifdef USE_FLOAT_PRECISION
+  typedef float       PixelType;
+  typedef float       TensorValueType;
+#else
+  typedef double      PixelType;
+  typedef double      TensorValueType;
+#endif
+
+  typedef itk::Image< PixelType, Dimension>           ImageType;
+
+  typedef itk::StageBenchmarkEdgeEnhancementDiffusionImageFilter< ImageType,
+                                             TensorValueType >  DiffusionFilterType;
+
+  typedef DiffusionFilterType::StructureTensorFilterType   StructureTensorFilterType;
+  typedef StructureTensorFilterType::OutputImageType       TensorImageType;
+  typedef DiffusionFilterType::EigenValueImageType         EigenValueImageType;
+  typedef DiffusionFilterType::EigenVectorImageType        EigenVectorImageType;
+  typedef itk::SymmetricEigenSystemAnalysisImageFilter< TensorImageType,
+    EigenValueImageType, EigenVectorImageType >    EigenSystemAnalysisFilterType;
+  typedef itk::SymmetricEigenVectorAnalysisImageFilter< TensorImageType,
+    EigenValueImageType, EigenVectorImageType >    EigenVectorAnalysisFilterType;
+
+  std::vector<int> threadCounts;
+  for ( int threads = 1; threads < maxNumberOfThreads; threads *= 2 )
+    {
+    threadCounts.push_back( threads );
+    }
+  threadCounts.push_back( maxNumberOfThreads );
+
+  std::vector<Timing> timings;
+
+  for ( unsigned int size = 64; size <= maxSize; size *= 2 )
+    {
+    // A bright ball on a ramp
+    ImageType::Pointer image = ImageType::New();
+    ImageType::SizeType imageSize;
+    imageSize.Fill( size );
+    ImageType::RegionType region;
+    region.SetSize( imageSize );
+    image->SetRegions( region );
+    image->Allocate();
+
+    itk::ImageRegionIteratorWithIndex< ImageType > it( image, region );
+    for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+      {
+      const ImageType::IndexType index = it.GetIndex();
+      double r2 = 0.0;
+      for ( unsigned int i = 0; i < Dimension; i++ )
+        {
+        const double d = index[i] - 0.5 * size;
+        r2 += d * d;
+        }
+      it.Set( static_cast<PixelType>( index[0] + ( r2 < 0.1 * size * size ? 100 : 0 ) ) );
+      }
+
+    StructureTensorFilterType::Pointer structureTensorFilter =
+      StructureTensorFilterType::New();
+    structureTensorFilter->SetInput( image );
+
+    EigenSystemAnalysisFilterType::Pointer eigenSystemFilter =
+      EigenSystemAnalysisFilterType::New();
+    eigenSystemFilter->SetDimension( Dimension );
+    eigenSystemFilter->SetUseClosedFormSolver( true );
+    eigenSystemFilter->SetInput( structureTensorFilter->GetOutput() );
+
+    EigenVectorAnalysisFilterType::Pointer eigenVectorFilter =
+      EigenVectorAnalysisFilterType::New();
+    eigenVectorFilter->SetDimension( Dimension );
+    eigenVectorFilter->SetUseClosedFormSolver( true );
+    eigenVectorFilter->SetInput( structureTensorFilter->GetOutput() );
+
+    // One iteration sets up the buffers; ManualReinitialization keeps them
+    DiffusionFilterType::Pointer diffusionFilter = DiffusionFilterType::New();
+    diffusionFilter->SetInput( image );
+    diffusionFilter->SetNumberOfIterations( 1 );
+    diffusionFilter->SetTimeStep( 0.01 );
+    diffusionFilter->ManualReinitializationOn();
+    diffusionFilter->UseFusedUpdateOff();
+
+    try
+      {
+      structureTensorFilter->Update();
+      diffusionFilter->Update();
+      }
+    catch( itk::ExceptionObject & err )
+      {
+      std::cerr << "Exception caught: " << err << std::endl;
+      return EXIT_FAILURE;
+      }
+
+    for ( unsigned int t = 0; t < threadCounts.size(); t++ )
+      {
+      const int threads = threadCounts[t];
+      structureTensorFilter->SetNumberOfThreads( threads );
+      eigenSystemFilter->SetNumberOfThreads( threads );
+      eigenVectorFilter->SetNumberOfThreads( threads );
+      // The diffusion filter passes the count on to its internal filters
+      diffusionFilter->SetNumberOfThreads( threads );
+
+      DiffusionTensorImageFunction<DiffusionFilterType> tensorFunction;
+      tensorFunction.Filter = diffusionFilter;
+      CalculateChangeFunction<DiffusionFilterType> changeFunction;
+      changeFunction.Filter = diffusionFilter;
+      ApplyUpdateFunction<DiffusionFilterType> updateFunction;
+      updateFunction.Filter = diffusionFilter;
+
+      try
+        {
+        Timing timing;
+        timing.Size = size;
+        timing.Threads = threads;
+
+        // The structure tensor input of the eigen filters is already up to
+        // date, so only the filter itself runs
+        timing.Stage = "StructureTensorRecursiveGaussian";
+        timing.Seconds = TimeStage(
+          MakeUpdateFunction( structureTensorFilter.GetPointer() ),
+          numberOfRepetitions );
+        timings.push_back( timing );
+
+        timing.Stage = "SymmetricEigenSystemAnalysis";
+        timing.Seconds = TimeStage(
+          MakeUpdateFunction( eigenSystemFilter.GetPointer() ),
+          numberOfRepetitions );
+        timings.push_back( timing );
+
+        timing.Stage = "SymmetricEigenVectorAnalysis";
+        timing.Seconds = TimeStage(
+          MakeUpdateFunction( eigenVectorFilter.GetPointer() ),
+          numberOfRepetitions );
+        timings.push_back( timing );
+
+        // The whole rebuild, then the assembly from the eigen system alone
+        tensorFunction.Assembly = false;
+        timing.Stage = "UpdateDiffusionTensorImage";
+        timing.Seconds = TimeStage( tensorFunction, numberOfRepetitions );
+        timings.push_back( timing );
+
+        tensorFunction.Assembly = true;
+        timing.Stage = "DiffusionTensorAssembly";
+        timing.Seconds = TimeStage( tensorFunction, numberOfRepetitions );
+        timings.push_back( timing );
+
+        timing.Stage = "CalculateChange";
+        timing.Seconds = TimeStage( changeFunction, numberOfRepetitions );
+        timings.push_back( timing );
+
+        timing.Stage = "ApplyUpdate";
+        timing.Seconds = TimeStage( updateFunction, numberOfRepetitions );
+        timings.push_back( timing );
+        }
+      catch( itk::ExceptionObject & err )
+        {
+        std::cerr << "Exception caught: " << err << std::endl;
+        return EXIT_FAILURE;
+        }
+      }
+    }
+
+  // Sort by stage, then size, then threads
+  std::cout << "# stage\tsize\tthreads\tseconds\tvoxels/s\tspeed-up" << std::endl;
+  const unsigned int numberOfStages = 7;
+  for ( unsigned int s = 0; s < numberOfStages; s++ )
+    {
+    for ( unsigned int i = s; i < timings.size(); i += numberOfStages )
+      {
+      const Timing & timing = timings[i];
+      if ( timing.Threads != threadCounts[0] )
+        {
+        continue;
+        }
+      for ( unsigned int t = 0; t < threadCounts.size(); t++ )
+        {
+        const Timing & scaled = timings[i + t * numberOfStages];
+        const double voxels = static_cast<double>( scaled.Size )
+          * scaled.Size * scaled.Size;
+        std::cout << scaled.Stage << "\t" << scaled.Size << "\t"
+                  << scaled.Threads << "\t" << scaled.Seconds << "\t"
+                  << voxels / scaled.Seconds << "\t"
+                  << timing.Seconds / scaled.Seconds << std::endl;
+        }
+      }
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -28,6 +28,16 @@ limitations under the License.
 #include "itkDiffusionTensor3D.h"
 #include "itkSymmetricSecondRankTensor.h"
 
+/** Tells the compiler that the buffers a row kernel reads and writes do
+ * not overlap, which it needs to vectorise the kernel */
+#if defined(__GNUC__) || defined(__clang__)
+#define ITK_DIFFUSION_RESTRICT __restrict__
+#elif defined(_MSC_VER)
+#define ITK_DIFFUSION_RESTRICT __restrict
+#else
+#define ITK_DIFFUSION_RESTRICT
+#endif
+
 namespace itk {
 
 /** \class AnisotropicDiffusionTensorFunction
@@ -38,7 +48,7 @@ namespace itk {
  * \ingroup FiniteDifferenceFunctions
  * \ingroup Functions
  */
-template <class TImageType>
+template <class TImageType, class TTensorValueType = double>
 class ITK_EXPORT AnisotropicDiffusionTensorFunction
   : public FiniteDifferenceFunction<TImageType>
 {
@@ -69,7 +79,10 @@ public:
   typedef typename Superclass::FloatOffsetType         FloatOffsetType;
 
 
-  typedef itk::Image< DiffusionTensor3D< double> , 3 > 
+  /** Type of the diffusion tensor components */
+  typedef TTensorValueType                             TensorValueType;
+
+  typedef itk::Image< DiffusionTensor3D< TensorValueType > , 3 > 
                                                DiffusionTensorImageType;
 
 
@@ -85,7 +98,14 @@ public:
                                            DiffusionTensorNeighborhoodType;
 
   /** Tensor pixel type */
-  typedef itk::SymmetricSecondRankTensor< double >  TensorPixelType; 
+  typedef itk::SymmetricSecondRankTensor< TensorValueType >  TensorPixelType; 
+
+  /** Type of the distance between two pixels of a diffusion tensor
+   * component buffer */
+  typedef typename ImageType::OffsetValueType          OffsetValueType;
+
+  /** Type of the length of a row of pixels */
+  typedef typename ImageType::SizeValueType            SizeValueType;
 
   /** A global data type for this class of equations.  Used to store
    * values that are needed in calculating the time step and other intermediate
@@ -122,6 +142,37 @@ public:
                      void *globalData,
                      const FloatOffsetType& = FloatOffsetType(0.0));
 
+  /** Compute the equation value, reading the diffusion tensor from its six
+   * component buffers ordered (0,0) (0,1) (0,2) (1,1) (1,2) (2,2).
+   * tensor[k] points to the value of component k at the center pixel.
+   * strideDown[i] and strideUp[i] are the buffer distances to the previous
+   * and the next pixel along axis i; they are 0 at the image boundary. */
+  virtual PixelType ComputeUpdate(
+                     const NeighborhoodType &neighborhood,
+                     const TensorValueType * const tensor[],
+                     const OffsetValueType strideDown[],
+                     const OffsetValueType strideUp[],
+                     void *globalData);
+
+  /** Compute the equation value for a row of length pixels along the first
+   * axis, all of which must be at least one pixel away from the image
+   * boundary. in points to the first intensity of the row and tensor[k] to
+   * the matching value of the component buffer k. stride[i] and
+   * tensorStride[i] are the distances between two neighbors along axis i
+   * in the intensity and in the tensor buffers. out receives the update,
+   * or in + dt * update when addToInput is true. out must not overlap the
+   * intensity or the tensor buffers. The loop body has no calls and no
+   * branches so the compiler can vectorise it. Only 3D images are
+   * supported. Returns the sum of the squared updates of the row. */
+  ScalarValueType ComputeUpdateRow(const PixelType * ITK_DIFFUSION_RESTRICT in,
+                        const TensorValueType * const tensor[],
+                        const OffsetValueType stride[],
+                        const OffsetValueType tensorStride[],
+                        SizeValueType length,
+                        bool addToInput,
+                        TimeStepType dt,
+                        PixelType * ITK_DIFFUSION_RESTRICT out) const;
+
   /** Computes the time step for an update given a global data structure. */
   virtual TimeStepType ComputeGlobalTimeStep(void *GlobalData) const;
 
@@ -154,6 +205,11 @@ protected:
 
   virtual ~AnisotropicDiffusionTensorFunction() {}
   void PrintSelf(std::ostream &s, Indent indent) const;
+
+  /** Compute the first and the second derivatives of the intensity at the
+   * center of the neighborhood and store them in the global data */
+  void ComputeIntensityDerivatives(const NeighborhoodType &neighborhood,
+                                   GlobalDataStruct *gd) const;
   
   /** Slices for the ND neighborhood. */
   std::slice x_slice[itkGetStaticConstMacro(ImageDimension)];
@@ -26,15 +26,60 @@ limitations under the License.
 #include "itkFiniteDifferenceImageFilter.h"
 #include "itkAnisotropicDiffusionTensorFunction.h"
 #include "itkMultiThreader.h"
+#include "itkImageRegionWorkQueue.h"
+#include "itkPersistentThreadPool.h"
+#include "itkRealTimeClock.h"
+#include "itkEventObject.h"
+
+#include <vector>
 #include "itkDiffusionTensor3D.h"
 #include "itkSymmetricEigenAnalysisImageFilter.h"
 #include "itkSymmetricEigenVectorAnalysisImageFilter.h"
 
 namespace itk {
+
+/** Invoked by AnisotropicDiffusionTensorImageFilter after each iteration,
+ * once the statistics of the iteration are available through
+ * GetIterationStatistics(). */
+itkEventMacro( DiffusionIterationStatisticsEvent, AnyEvent );
 /** \class AnisotropicDiffusionTensorImageFilter
  * \brief This is a superclass for filters that iteratively enhance edge in 
  *        an image by solving non-linear diffusion equation.
  *
+ * The root mean square change of the image is computed at each iteration
+ * (see GetRMSChange()). The filter stops before NumberOfIterations is
+ * reached once that change falls below MaximumRMSError. MaximumRMSError is
+ * 0 by default, so all the iterations are run.
+ *
+ * The filter can be streamed. The output requested region is padded by a
+ * halo of GetStreamingHaloRadius() pixels, the distance information travels
+ * in NumberOfIterations iterations, and the whole computation, including
+ * the structure tensor, only uses the padded region. To bound the memory,
+ * set MemoryBudget and split the output into GetNumberOfStreamDivisions()
+ * pieces with a streaming writer or StreamingImageFilter.
+ *
+ * The halo is an approximation. The recursive Gaussian filters of the
+ * structure tensor have no finite support and are taken as cut at three
+ * standard deviations, so near the edges of a padded piece the structure
+ * tensor differs slightly from the one of the whole image. A streamed output
+ * therefore only agrees with the output of the whole image within a small
+ * tolerance, not bit for bit. The halo also grows linearly with the number
+ * of iterations: with Sigma and SigmaOuter of 1 each iteration adds 8
+ * slices, so 100 iterations need 800 slices on each side of a piece, and
+ * GetNumberOfStreamDivisions() throws when MemoryBudget cannot hold them.
+ * Streaming suits a few iterations on a large volume.
+ *
+ * The input pixel type may differ from the output pixel type, e.g. a
+ * short CT volume diffused into a float or double output. The input is
+ * converted once, by CopyInputToOutput(), and otherwise only read by the
+ * gradient magnitude of the subclasses; it is never held in the output
+ * pixel type.
+ *
+ * The wall time of each phase, the busy time of each thread and the RMS
+ * change of every iteration of the last run are kept, see
+ * GetIterationStatistics(). A DiffusionIterationStatisticsEvent is invoked
+ * after each iteration. Nothing is written to the console unless Verbose
+ * is on.
  * 
  * \sa AnisotropicEdgeEnhancementDiffusionImageFilter
  * \sa AnisotropicCoherenceEnhancingDiffusionImageFilter
@@ -44,7 +89,8 @@ namespace itk {
  */
 
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage,
+          class TTensorValueType = double>
 class ITK_EXPORT AnisotropicDiffusionTensorImageFilter  
   : public FiniteDifferenceImageFilter<TInputImage, TOutputImage>
 {
@@ -68,31 +114,41 @@ public:
   typedef typename Superclass::OutputImageType OutputImageType;
   typedef typename Superclass::PixelType       PixelType;
 
-  typedef itk::Image< DiffusionTensor3D< double > , 3 > 
+  /** Type of the diffusion tensor components. Use float to halve the
+   * memory and bandwidth used by the diffusion tensor image. */
+  typedef TTensorValueType                      TensorValueType;
+
+  typedef itk::Image< DiffusionTensor3D< TensorValueType > , 3 > 
                                                 DiffusionTensorImageType;
 
+  /** The diffusion tensor field is stored as one scalar image per
+   * independent tensor component, in the order (0,0) (0,1) (0,2) (1,1)
+   * (1,2) (2,2), so the stencil reads each component with plain strides. */
+  typedef itk::Image< TensorValueType, 3 >      DiffusionTensorComponentImageType;
+
+  itkStaticConstMacro(NumberOfDiffusionTensorComponents, unsigned int, 6);
+
   /** Dimensionality of input and output data is assumed to be the same.
    * It is inherited from the superclass. */
   itkStaticConstMacro(ImageDimension, unsigned int,Superclass::ImageDimension);
 
-  typedef AnisotropicDiffusionTensorFunction<InputImageType>  
-                                                  FiniteDifferenceFunctionType;
-  
   typedef itk::Image< double, 3 >               VesselnessOutputImageType;
 
-  typedef itk::Matrix<double, ImageDimension, ImageDimension> MatrixType;
+  typedef itk::Matrix<TensorValueType, ImageDimension, ImageDimension>
+                                                         MatrixType;
 
   // Define image of matrix pixel type 
   typedef itk::Image< MatrixType, ImageDimension>  OutputMatrixImageType;
 
   // Define the symmetric tensor pixel type
-  typedef itk::SymmetricSecondRankTensor< double, ImageDimension> 
+  typedef itk::SymmetricSecondRankTensor< TensorValueType, ImageDimension> 
                                                          TensorPixelType;
   typedef itk::Image< TensorPixelType, ImageDimension>  
                                                          TensorImageType;
 
    // Define the type for storing the eigen-value
-  typedef itk::FixedArray< double, ImageDimension >      EigenValueArrayType;
+  typedef itk::FixedArray< TensorValueType, ImageDimension >
+                                                         EigenValueArrayType;
   
   // Declare the types of the output images
   typedef itk::Image< EigenValueArrayType, ImageDimension >  
@@ -104,6 +160,11 @@ public:
   /** The container type for the update buffer. */
   typedef OutputImageType UpdateBufferType;
 
+  /** The solver works on the output, so the function is defined on the
+   * output image type whatever the input pixel type is. */
+  typedef AnisotropicDiffusionTensorFunction<UpdateBufferType, TensorValueType>
+                                                  FiniteDifferenceFunctionType;
+
   /** Define diffusion image nbd type */
   typedef typename FiniteDifferenceFunctionType::DiffusionTensorNeighborhoodType
                                                DiffusionTensorNeighborhoodType;
@@ -114,6 +175,161 @@ public:
 
   itkGetMacro( TimeStep, double ); 
 
+  /** When on, CalculateChange() writes u + dt * update straight into the
+   * update buffer, which then becomes the output by swapping the pixel
+   * containers in ApplyUpdate(). The update buffer works as a ping-pong
+   * image and the separate update pass over the volume is skipped. This is
+   * valid because the time step is fixed and known before the sweep. The
+   * update is rounded as in the two passes, so the output is the same bit
+   * for bit. Default is off. */
+  itkSetMacro( UseFusedUpdate, bool );
+  itkGetConstMacro( UseFusedUpdate, bool );
+  itkBooleanMacro( UseFusedUpdate );
+
+  /** When on, the image is updated with the semi-implicit additive operator
+   * splitting (AOS) scheme of Weickert et al.,
+   *   u(t+dt) = 1/m sum_l ( I - m dt A_l )^-1 ( u + dt M u ),
+   * where m is the image dimension, A_l the diffusion along axis l and M u
+   * the mixed derivative terms, which stay explicit. The filter still warns
+   * above the explicit time step limit. UseFusedUpdate is ignored in this
+   * mode. Default is off. */
+  itkSetMacro( UseSemiImplicitScheme, bool );
+  itkGetConstMacro( UseSemiImplicitScheme, bool );
+  itkBooleanMacro( UseSemiImplicitScheme );
+
+  /** The diffusion tensor image changes slowly compared with the image, so
+   * it does not have to be rebuilt at every iteration. It is rebuilt at the
+   * first iteration and then every DiffusionTensorUpdateInterval
+   * iterations. Default is 1, i.e. at every iteration. */
+  itkSetClampMacro( DiffusionTensorUpdateInterval, unsigned int,
+                    1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( DiffusionTensorUpdateInterval, unsigned int );
+
+  /** When larger than 0, the diffusion tensor image is also rebuilt as soon
+   * as the sum of the RMS changes of the image since the last rebuild
+   * reaches this threshold. DiffusionTensorUpdateInterval then bounds the
+   * number of iterations between two rebuilds. Default is 0 (off). */
+  itkSetMacro( DiffusionTensorUpdateThreshold, double );
+  itkGetConstMacro( DiffusionTensorUpdateThreshold, double );
+
+  /** When larger than 1, the explicit scheme advances up to
+   * TemporalBlockSize iterations on one tile before moving to the next, so
+   * the tile stays in cache instead of the whole volume being streamed
+   * through memory twice per iteration. The tiles are TemporalTileSize
+   * pixels wide across the last two axes and hold whole rows along the
+   * first axis; each one carries a halo of one pixel per iteration. The
+   * diffusion tensor image is frozen during a block, so it is only rebuilt
+   * between blocks. Ignored with the semi-implicit scheme. Default is 1
+   * (off). */
+  itkSetClampMacro( TemporalBlockSize, unsigned int,
+                    1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( TemporalBlockSize, unsigned int );
+
+  /** Width of the tiles of a temporal block. Default is 16. */
+  itkSetClampMacro( TemporalTileSize, unsigned int,
+                    1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( TemporalTileSize, unsigned int );
+
+  /** The stencil and the update passes cut the requested region into about
+   * NumberOfChunksPerThread chunks of rows per thread. The threads take the
+   * chunks from a shared queue and steal from each other when their own
+   * share runs out. More chunks balance the load better at a small cost
+   * per chunk. Default is 8. */
+  itkSetClampMacro( NumberOfChunksPerThread, unsigned int,
+                    1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( NumberOfChunksPerThread, unsigned int );
+
+  /** The worker threads of the parallel sections. GenerateData() starts the
+   * pool when it is not running and stops it at the end, so the threads are
+   * created once per run instead of once per parallel section. A pool
+   * started by the caller is used as it is and may be shared by several
+   * filters that run one after the other. */
+  void SetThreadPool( PersistentThreadPool *pool );
+  itkGetObjectMacro( ThreadPool, PersistentThreadPool );
+
+  /** When on, the output, the update buffer and the diffusion tensor images
+   * are first written by the threads that later update them, so on a NUMA
+   * system the operating system places each page on the node that uses it.
+   * The pages follow the chunks the work queue deals out to each thread.
+   * Use it together with PinThreads so the threads stay on their nodes.
+   * Default is off. */
+  itkSetMacro( UseFirstTouchAllocation, bool );
+  itkGetConstMacro( UseFirstTouchAllocation, bool );
+  itkBooleanMacro( UseFirstTouchAllocation );
+
+  /** Bind the threads of the thread pool to fixed processors for the whole
+   * run. Only used when GenerateData() starts the pool itself. Default is
+   * off. \sa PersistentThreadPool::SetPinThreads */
+  itkSetMacro( PinThreads, bool );
+  itkGetConstMacro( PinThreads, bool );
+  itkBooleanMacro( PinThreads );
+
+  /** The phases of an iteration that are timed. StructureTensorPhase
+   * includes the gradient magnitude filter of the filters that use one.
+   * CalculateChangePhase includes whole temporal blocks and ApplyUpdatePhase
+   * the solves of the semi-implicit scheme. */
+  typedef enum {
+    StructureTensorPhase = 0,
+    EigenAnalysisPhase,
+    TensorAssemblyPhase,
+    CalculateChangePhase,
+    ApplyUpdatePhase,
+    NumberOfPhases
+  } PhaseType;
+
+  /** Timing and counters of one iteration. The times are in seconds. */
+  struct IterationStatistics
+    {
+    /** Number of elapsed iterations after this one */
+    unsigned int        Iteration;
+    /** Number of iterations advanced, more than one for a temporal block */
+    unsigned int        NumberOfSteps;
+    /** Whether the diffusion tensor image was rebuilt before the iteration */
+    bool                DiffusionTensorUpdated;
+    /** Wall time of each phase, indexed by PhaseType */
+    double              PhaseTime[NumberOfPhases];
+    /** Time each thread spent in the parallel sections */
+    std::vector<double> ThreadBusyTime;
+    /** Bytes of the buffers of the filter and its internal pipelines */
+    double              BytesAllocated;
+    /** Root mean square change of the iteration */
+    double              RMSChange;
+    };
+  typedef std::vector<IterationStatistics> IterationStatisticsContainer;
+
+  /** Statistics of every iteration of the last run, in order */
+  const IterationStatisticsContainer & GetIterationStatistics() const
+    {
+    return m_IterationStatistics;
+    }
+
+  /** Name of a phase, for reports */
+  static const char * GetPhaseName( unsigned int phase );
+
+  /** Print one line per iteration to std::cout. Default is off. */
+  itkSetMacro( Verbose, bool );
+  itkGetConstMacro( Verbose, bool );
+  itkBooleanMacro( Verbose );
+
+  /** Memory, in megabytes, that one piece of a streamed execution may use.
+   * 0 (the default) means no limit. */
+  itkSetMacro( MemoryBudget, double );
+  itkGetConstMacro( MemoryBudget, double );
+
+  /** Number of pixels the output requested region is padded by on each
+   * side. Each iteration reads the neighbors of a pixel and the diffusion
+   * tensors of the neighbors, so the halo grows with NumberOfIterations:
+   * it is NumberOfIterations times the stencil radius of 1 plus the
+   * structure tensor radius, cut at three standard deviations. */
+  unsigned long GetStreamingHaloRadius() const;
+
+  /** Number of pieces, along the last axis, the output has to be split into
+   * so that each piece and its halo fit in MemoryBudget. Pass it to the
+   * streaming writer or StreamingImageFilter downstream. The output
+   * information must be up to date. An exception is thrown when a single
+   * slice and its halo do not fit. */
+  unsigned int GetNumberOfStreamDivisions();
+
 #ifdef ITK_USE_CONCEPT_CHECKING
   /** Begin concept checking */
   itkConceptMacro(OutputTimesDoubleCheck,
@@ -133,9 +349,33 @@ protected:
   /* overloaded GenerateData method */
   virtual void GenerateData(); 
 
+  /** Pad the output requested region by the streaming halo */
+  void EnlargeOutputRequestedRegion(DataObject *output);
+
+  /** Radius of the part of the image the diffusion tensor of a pixel
+   * depends on. The default is 0; subclasses return the extent of the
+   * kernels they build the tensors with. */
+  virtual unsigned long GetDiffusionTensorRadius() const
+    { return 0; }
+
+  /** Approximate memory used per pixel of the processed region, in bytes.
+   * Subclasses add the images of their internal pipelines. */
+  virtual double GetNumberOfBytesPerPixel() const;
+
+  /** Images that share the pixel buffers of the output and of the input
+   * and whose largest possible region is their buffered region. The
+   * internal pipelines of the subclasses read these, so they never request
+   * more than the part of the volume that is in memory. The input image is
+   * set up again at each GenerateData(); the output image follows the
+   * output pixel container, which the fused update swaps. */
+  OutputImageType * GetOutputBufferImage();
+  const InputImageType * GetInputBufferImage() const
+    { return m_InputBufferImage; }
+
   /** A simple method to copy the data from the input to the output. ( Supports
    * "read-only" image adaptors in the case where the input image type converts
-   * to a different output image type. )  */
+   * to a different output image type. ) The copy is multithreaded with the
+   * ThreadedCopyInputToOutput() method. */
   virtual void CopyInputToOutput();
 
   /** This method applies changes from the m_UpdateBuffer to the output using
@@ -160,17 +400,49 @@ protected:
   /** This method allocates storage for the diffusion tensor image */
   void AllocateDiffusionTensorImage();
  
+  /** The type of region used for multithreading */
+  typedef typename UpdateBufferType::RegionType ThreadRegionType;
+
+  /** Fill the output, the update buffer and the diffusion tensor images
+   * with zeros from the threads that process them, using the
+   * ThreadedFirstTouchBuffers() method and a multithreading mechanism. */
+  virtual void FirstTouchBuffers();
+
+  /** Fill the buffers over one chunk of the requested region. */
+  virtual
+  void ThreadedFirstTouchBuffers(const ThreadRegionType &regionToProcess,
+                                 int threadId);
+
+  /** Copy and convert the input over one chunk of the requested region.
+   * Runs of pixels that are contiguous in both buffers are converted by a
+   * plain loop the compiler can vectorise: whole chunks when the input and
+   * the output buffer the same region, single rows otherwise. */
+  virtual
+  void ThreadedCopyInputToOutput(const ThreadRegionType &regionToProcess,
+                                 int threadId);
+
   /** Update diffusion tensor image */
   void virtual UpdateDiffusionTensorImage() = 0;
  
-  /** The type of region used for multithreading */
-  typedef typename UpdateBufferType::RegionType ThreadRegionType;
+  /** Run callback on every thread with data as its UserData, on the thread
+   * pool when it is running and through the multithreader otherwise. */
+  void ExecuteThreaderCallback( ThreadFunctionType callback, void *data );
+
+  /** Number of threads ExecuteThreaderCallback() runs the callback on. */
+  int GetNumberOfThreaderThreads();
+
+  /** Start and stop the clock of a phase of the current iteration. The time
+   * between the two calls is added to the phase. */
+  void BeginPhase( PhaseType phase );
+  void EndPhase( PhaseType phase );
 
   /** The type of region used for multithreading */
-  typedef typename DiffusionTensorImageType::RegionType 
+  typedef typename DiffusionTensorComponentImageType::RegionType 
                                         ThreadDiffusionTensorImageRegionType;
 
-  typedef typename DiffusionTensorImageType::Pointer DiffusionTensorImagePointerType;
+  /** The queue the threads take their chunks of rows from */
+  typedef ImageRegionWorkQueue<itkGetStaticConstMacro(ImageDimension)>
+                                                          WorkQueueType;
 
   /**  Does the actual work of updating the output from the UpdateContainer 
    *   over an output region supplied by the multithreading mechanism.
@@ -184,19 +456,93 @@ protected:
                 int threadId);
 
   /** Does the actual work of calculating change over a region supplied by
-   * the multithreading mechanism.
+   * the multithreading mechanism. The sum of the squared updates of the
+   * region is returned in sumOfSquaredUpdate.
    * \sa CalculateChange
    * \sa CalculateChangeThreaderCallback */
   virtual
   TimeStepType ThreadedCalculateChange(
                const ThreadRegionType &regionToProcess,
+               const ThreadDiffusionTensorImageRegionType &diffusionRegionToProcess,
+               double &sumOfSquaredUpdate,
+               int threadId);
+
+  /** Compute the change of each pixel of regionToProcess of input and write
+   * it, or input + dt * change when addToInput is true, to output. The
+   * images must have the same extent along the first axis and lie within
+   * the diffusion tensor image. ThreadedCalculateChange() calls it with the
+   * output and the update buffer. The sum of the squared changes is
+   * returned in sumOfSquaredUpdate. */
+  TimeStepType CalculateChangeOverRegion(const OutputImageType *input,
+                                         UpdateBufferType *output,
+                                         const ThreadRegionType &regionToProcess,
+                                         bool addToInput,
+                                         double &sumOfSquaredUpdate);
+
+  /** Advance the output by numberOfSteps iterations, one tile at a time,
+   * using the ThreadedApplyTemporalBlock() method and a multithreading
+   * mechanism. */
+  virtual void ApplyTemporalBlock(unsigned int numberOfSteps);
+
+  /** Does the actual work of a temporal block. The thread processes every
+   * threadCount-th tile, starting with tile threadId, and returns the sum of
+   * the squared changes of its tiles in sumOfSquaredChange.
+   * \sa ApplyTemporalBlock */
+  virtual
+  void ThreadedApplyTemporalBlock(unsigned int numberOfSteps, int threadId,
+                                  int threadCount, double &sumOfSquaredChange);
+
+  /** This method fills the diffusion tensor image using the
+   * ThreadedGenerateDiffusionTensorImage() method and a multithreading
+   * mechanism. Subclasses call it from UpdateDiffusionTensorImage() once the
+   * images the tensors are built from are up to date. */
+  void GenerateDiffusionTensorImage();
+
+  /** Does the actual work of computing the diffusion tensors over a region
+   * supplied by the multithreading mechanism. The default implementation
+   * does nothing.
+   * \sa GenerateDiffusionTensorImage
+   * \sa GenerateDiffusionTensorImageThreaderCallback */
+  virtual
+  void ThreadedGenerateDiffusionTensorImage(
                const ThreadDiffusionTensorImageRegionType &diffusionRegionToProcess,
                int threadId);
 
+  /** Update the output with the semi-implicit AOS scheme and set the RMS
+   * change from the difference between the new and the old output. */
+  virtual void ApplySemiImplicitUpdate(TimeStepType dt);
+
+  /** Write the right hand side u + dt M u of the AOS scheme to the update
+   * buffer over a region supplied by the multithreading mechanism.
+   * \sa ApplySemiImplicitUpdate */
+  virtual
+  void ThreadedComputeSemiImplicitRightHandSide(TimeStepType dt,
+                const ThreadRegionType &regionToProcess,
+                int threadId);
+
+  /** Solve the tridiagonal systems of the lines along axis that start in a
+   * region supplied by the multithreading mechanism, and add the solutions
+   * divided by the image dimension to the semi-implicit buffer. The first
+   * axis sets the buffer instead of adding to it. The last axis adds the
+   * squared change of the output to sumOfSquaredChange.
+   * \sa ApplySemiImplicitUpdate */
+  virtual
+  void ThreadedSolveSemiImplicitAxis(TimeStepType dt, unsigned int axis,
+                const ThreadRegionType &regionToProcess,
+                int threadId, double &sumOfSquaredChange);
+
+  /** Split the requested region into pieces that each hold whole lines
+   * along axis. The arguments and the return value are the same as the
+   * ones of ImageSource::SplitRequestedRegion(). */
+  int SplitRequestedRegionAcrossAxis(int i, int num, unsigned int axis,
+                                     ThreadRegionType &splitRegion);
+
   /** Prepare for the iteration process. */
   virtual void InitializeIteration();
 
-  DiffusionTensorImagePointerType GetDiffusionTensorImage();
+  /** Get the image of one component of the diffusion tensor field */
+  DiffusionTensorComponentImageType *
+    GetDiffusionTensorComponentImage( unsigned int component );
 
 private:
   //purposely not implemented
@@ -211,23 +557,111 @@ private:
     TimeStepType TimeStep;
     TimeStepType *TimeStepList;
     bool *ValidTimeStepList;
+    double *SumOfSquaredUpdateList;
+    unsigned int Axis;
+    unsigned int NumberOfSteps;
+    WorkQueueType *WorkQueue;
     };
     
-  /** This callback method uses ImageSource::SplitRequestedRegion to acquire an
-   * output region that it passes to ThreadedApplyUpdate for processing. */
+  /** This callback method takes chunks of the output region from the work
+   * queue and passes them to ThreadedApplyUpdate for processing until the
+   * queue is empty. */
   static ITK_THREAD_RETURN_TYPE ApplyUpdateThreaderCallback( void *arg );
   
-  /** This callback method uses SplitUpdateContainer to acquire a region
-   * which it then passes to ThreadedCalculateChange for processing. */
+  /** This callback method takes chunks of the output region from the work
+   * queue and passes them to ThreadedCalculateChange for processing until
+   * the queue is empty. */
   static ITK_THREAD_RETURN_TYPE CalculateChangeThreaderCallback( void *arg );
+
+  /** This callback method takes the chunks of the thread from the work
+   * queue, without stealing, and passes them to
+   * ThreadedGenerateDiffusionTensorImage. */
+  static ITK_THREAD_RETURN_TYPE
+    GenerateDiffusionTensorImageThreaderCallback( void *arg );
+
+  /** These callback methods pass a region to
+   * ThreadedComputeSemiImplicitRightHandSide and ThreadedSolveSemiImplicitAxis
+   * for processing. */
+  static ITK_THREAD_RETURN_TYPE
+    SemiImplicitRightHandSideThreaderCallback( void *arg );
+  static ITK_THREAD_RETURN_TYPE
+    SemiImplicitSolveThreaderCallback( void *arg );
+
+  /** Arguments of TimedThreaderCallback */
+  struct TimedThreaderStruct
+    {
+    ThreadFunctionType Callback;
+    void *UserData;
+    double *BusyTime;
+    const RealTimeClock *Clock;
+    };
+
+  /** This callback method runs another callback and adds the time the
+   * thread spent in it to its busy time. */
+  static ITK_THREAD_RETURN_TYPE TimedThreaderCallback( void *arg );
+
+  /** This callback method takes the chunks of the thread from the work
+   * queue, without stealing, and passes them to ThreadedFirstTouchBuffers. */
+  static ITK_THREAD_RETURN_TYPE FirstTouchBuffersThreaderCallback( void *arg );
+
+  /** This callback method takes the chunks of the thread from the work
+   * queue, without stealing, and passes them to ThreadedCopyInputToOutput. */
+  static ITK_THREAD_RETURN_TYPE CopyInputToOutputThreaderCallback( void *arg );
+
+  /** This callback method passes the thread id and count to
+   * ThreadedApplyTemporalBlock for processing. */
+  static ITK_THREAD_RETURN_TYPE TemporalBlockThreaderCallback( void *arg );
  
-  typename DiffusionTensorImageType::Pointer            m_DiffusionTensorImage;
+  typename DiffusionTensorComponentImageType::Pointer
+    m_DiffusionTensorComponentImages[NumberOfDiffusionTensorComponents];
 
   /** The buffer that holds the updates for an iteration of the algorithm. */
   typename UpdateBufferType::Pointer m_UpdateBuffer;
 
+  /** The buffer the semi-implicit solves build the new output in. */
+  typename UpdateBufferType::Pointer m_SemiImplicitBuffer;
+
   TimeStepType                                          m_TimeStep;
 
+  bool                                                  m_UseFusedUpdate;
+
+  bool                                                  m_UseSemiImplicitScheme;
+
+  double                                        m_MemoryBudget;
+
+  typename InputImageType::Pointer              m_InputBufferImage;
+  typename OutputImageType::Pointer             m_OutputBufferImage;
+
+  unsigned int                                  m_DiffusionTensorUpdateInterval;
+  double                                        m_DiffusionTensorUpdateThreshold;
+
+  /** Iterations and accumulated RMS change since the last rebuild of the
+   * diffusion tensor image */
+  unsigned int                                  m_IterationsSinceDiffusionTensorUpdate;
+  double                                        m_ChangeSinceDiffusionTensorUpdate;
+  unsigned int                                  m_PreviousElapsedIterations;
+
+  unsigned int                                  m_TemporalBlockSize;
+  unsigned int                                  m_TemporalTileSize;
+
+  unsigned int                                  m_NumberOfChunksPerThread;
+
+  PersistentThreadPool::Pointer                 m_ThreadPool;
+  bool                                          m_UseFirstTouchAllocation;
+  bool                                          m_PinThreads;
+
+  bool                                          m_Verbose;
+  RealTimeClock::Pointer                        m_Clock;
+  RealTimeClock::TimeStampType                  m_PhaseStartTime[NumberOfPhases];
+  IterationStatistics                           m_CurrentStatistics;
+  IterationStatisticsContainer                  m_IterationStatistics;
+  double                                        m_ThreadBusyTime[ITK_MAX_THREADS];
+
+  /** Per thread results of CalculateChange(), kept between iterations */
+  TimeStepType                                  m_TimeStepList[ITK_MAX_THREADS];
+  bool                                          m_ValidTimeStepList[ITK_MAX_THREADS];
+  double                                        m_SumOfSquaredUpdateList[ITK_MAX_THREADS];
+
 };
   
 
@@ -27,7 +27,9 @@ limitations under the License.
 #include "itkAnisotropicDiffusionTensorFunction.h"
 
 #include <list>
+#include <vector>
 #include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
 #include "itkImageRegionIterator.h"
 #include "itkNumericTraits.h"
 #include "itkNeighborhoodAlgorithm.h"
@@ -35,6 +37,9 @@ limitations under the License.
 #include "itkImageFileWriter.h"
 #include "itkVector.h"
 #include "itkFixedArray.h"
+#include "vnl/vnl_math.h"
+
+#include <algorithm>
 
 //#define INTERMEDIATE_OUTPUTS
 
@@ -43,36 +48,74 @@ namespace itk {
 /**
  * Constructor
  */
-template <class TInputImage, class TOutputImage>
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::AnisotropicDiffusionTensorImageFilter()
 {
   m_UpdateBuffer = UpdateBufferType::New(); 
+  m_SemiImplicitBuffer = UpdateBufferType::New();
 
-  m_DiffusionTensorImage  = DiffusionTensorImageType::New();
+  for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+    {
+    m_DiffusionTensorComponentImages[k] = DiffusionTensorComponentImageType::New();
+    }
  
   this->SetNumberOfIterations(1);
 
   m_TimeStep = 0.11; 
 
+  m_UseFusedUpdate = false;
+
+  m_UseSemiImplicitScheme = false;
+
+  m_MemoryBudget = 0.0;
+
+  m_InputBufferImage = InputImageType::New();
+  m_OutputBufferImage = OutputImageType::New();
+
+  m_DiffusionTensorUpdateInterval = 1;
+  m_DiffusionTensorUpdateThreshold = 0.0;
+  m_IterationsSinceDiffusionTensorUpdate = 0;
+  m_ChangeSinceDiffusionTensorUpdate = 0.0;
+  m_PreviousElapsedIterations = 0;
+
+  m_TemporalBlockSize = 1;
+  m_TemporalTileSize = 16;
+
+  m_NumberOfChunksPerThread = 8;
+
+  m_ThreadPool = PersistentThreadPool::New();
+  m_UseFirstTouchAllocation = false;
+  m_PinThreads = false;
+
+  m_Verbose = false;
+  m_Clock = RealTimeClock::New();
+  for( unsigned int p = 0; p < NumberOfPhases; p++ )
+    {
+    m_PhaseStartTime[p] = 0.0;
+    }
+  for( unsigned int i = 0; i < ITK_MAX_THREADS; i++ )
+    {
+    m_ThreadBusyTime[i] = 0.0;
+    }
+
   //set the function
-  typename AnisotropicDiffusionTensorFunction<UpdateBufferType>::Pointer q
-      = AnisotropicDiffusionTensorFunction<UpdateBufferType>::New();
+  typename AnisotropicDiffusionTensorFunction<UpdateBufferType, TTensorValueType>::Pointer q
+      = AnisotropicDiffusionTensorFunction<UpdateBufferType, TTensorValueType>::New();
   this->SetDifferenceFunction(q);
 
 }
 
 /** Prepare for the iteration process. */
- template <class TInputImage, class TOutputImage>
+ template <class TInputImage, class TOutputImage, class TTensorValueType>
  void
- AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
  ::InitializeIteration()
 {
-  //itkDebugMacro( << "InitializeIteration() called " );
-  std::cerr << "InitalizeIteration" << std::endl;
+  itkDebugMacro( << "InitializeIteration() called " );
 
-  AnisotropicDiffusionTensorFunction<UpdateBufferType> *f = 
-     dynamic_cast<AnisotropicDiffusionTensorFunction<UpdateBufferType> *>
+  AnisotropicDiffusionTensorFunction<UpdateBufferType, TTensorValueType> *f = 
+     dynamic_cast<AnisotropicDiffusionTensorFunction<UpdateBufferType, TTensorValueType> *>
      (this->GetDifferenceFunction().GetPointer());
 
   if (! f)
@@ -102,6 +145,8 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
     minSpacing = 1.0;
     }
 
+  // The mixed derivative terms stay explicit in the semi-implicit scheme,
+  // so the explicit limit holds for both
   double ratio = 
      minSpacing /vcl_pow(2.0, static_cast<double>(ImageDimension) + 1);
 
@@ -125,13 +170,39 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
     this->UpdateProgress(0);
     }
 
- //Update the Diffusion tensor image
-  this->UpdateDiffusionTensorImage();
+  // Update the diffusion tensor image at the first iteration, then once
+  // the interval or the change threshold is reached. A temporal block
+  // advances several iterations between two calls.
+  bool updateDiffusionTensor = true;
+  if ( this->GetElapsedIterations() > 0 )
+    {
+    const unsigned int steps =
+      this->GetElapsedIterations() - m_PreviousElapsedIterations;
+    m_IterationsSinceDiffusionTensorUpdate += steps;
+    m_ChangeSinceDiffusionTensorUpdate += steps * this->GetRMSChange();
+
+    updateDiffusionTensor =
+      m_IterationsSinceDiffusionTensorUpdate >= m_DiffusionTensorUpdateInterval
+      || ( m_DiffusionTensorUpdateThreshold > 0.0
+           && m_ChangeSinceDiffusionTensorUpdate
+              >= m_DiffusionTensorUpdateThreshold );
+    }
+
+  if ( updateDiffusionTensor )
+    {
+    this->UpdateDiffusionTensorImage();
+
+    m_IterationsSinceDiffusionTensorUpdate = 0;
+    m_ChangeSinceDiffusionTensorUpdate = 0.0;
+    }
+  m_CurrentStatistics.DiffusionTensorUpdated = updateDiffusionTensor;
+
+  m_PreviousElapsedIterations = this->GetElapsedIterations();
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::CopyInputToOutput()
 {
   typename TInputImage::ConstPointer  input  = this->GetInput();
@@ -154,26 +225,132 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
       }
     }
   
-  ImageRegionConstIterator<TInputImage>  in(input, output->GetRequestedRegion());
-  ImageRegionIterator<TOutputImage> out(output, output->GetRequestedRegion());
+  // Deal out the chunks exactly as FirstTouchBuffers() does, so each thread
+  // copies into the pages it touched first and updates later
+  DenseFDThreadStruct str;
+  str.Filter = this;
+  str.TimeStep = NumericTraits<TimeStepType>::Zero;  // Not used here
+
+  WorkQueueType workQueue;
+  workQueue.Initialize( output->GetRequestedRegion(),
+                        this->GetNumberOfThreaderThreads(),
+                        m_NumberOfChunksPerThread );
+  str.WorkQueue = &workQueue;
+
+  // Multithread the execution
+  this->ExecuteThreaderCallback( this->CopyInputToOutputThreaderCallback, &str );
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+ITK_THREAD_RETURN_TYPE
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::CopyInputToOutputThreaderCallback( void * arg )
+{
+  DenseFDThreadStruct * str;
+  int threadId;
+
+  threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+
+  str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  ThreadRegionType chunk;
+  while ( str->WorkQueue->GetNextChunk(threadId, chunk, false) )
+    {
+    str->Filter->ThreadedCopyInputToOutput(chunk, threadId);
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedCopyInputToOutput(const ThreadRegionType &regionToProcess, int)
+{
+  typedef typename InputImageType::PixelType          InputPixelType;
+  typedef typename InputImageType::InternalPixelType  InputInternalPixelType;
+  typedef typename OutputImageType::SizeType          SizeType;
+  typedef typename OutputImageType::SizeValueType     SizeValueType;
+  typedef typename OutputImageType::IndexType         IndexType;
+
+  const InputImageType * input = this->GetInput();
+  OutputImageType * output = this->GetOutput();
+
+  // An image adaptor converts its pixels on access, so they cannot be read
+  // from its buffer
+  if ( typeid(InputInternalPixelType) != typeid(InputPixelType) )
+    {
+    ImageRegionConstIterator<InputImageType> in(input, regionToProcess);
+    ImageRegionIterator<OutputImageType> out(output, regionToProcess);
+    for ( ; !out.IsAtEnd(); ++in, ++out )
+      {
+      out.Set( static_cast<PixelType>( in.Get() ) );
+      }
+    return;
+    }
+
+  // Rows along the first axis are contiguous in both buffers. The whole
+  // chunk is when both buffers cover the same region and the chunk only
+  // spans more than one pixel along the axis above the last partial one.
+  const SizeType & size = regionToProcess.GetSize();
+  const SizeType & bufferedSize = output->GetBufferedRegion().GetSize();
+  bool contiguous =
+    ( input->GetBufferedRegion() == output->GetBufferedRegion() );
+  bool partial = false;
+  for ( unsigned int d = 0; contiguous && d < ImageDimension; d++ )
+    {
+    if ( partial && size[d] != 1 )
+      {
+      contiguous = false;
+      }
+    if ( size[d] != bufferedSize[d] )
+      {
+      partial = true;
+      }
+    }
+
+  const SizeValueType numberOfPixels = regionToProcess.GetNumberOfPixels();
+  if ( numberOfPixels == 0 )
+    {
+    return;
+    }
+  const SizeValueType runLength = contiguous ? numberOfPixels : size[0];
+  const SizeValueType numberOfRuns = numberOfPixels / runLength;
 
-  while( ! out.IsAtEnd() )
+  const InputInternalPixelType * inBuffer = input->GetBufferPointer();
+  PixelType * outBuffer = output->GetBufferPointer();
+
+  const IndexType & start = regionToProcess.GetIndex();
+  IndexType index = start;
+  for ( SizeValueType r = 0; r < numberOfRuns; r++ )
     {
-    out.Value() =  static_cast<PixelType>(in.Get());  
-    ++in;
-    ++out;
+    const InputInternalPixelType * in = inBuffer + input->ComputeOffset( index );
+    PixelType * out = outBuffer + output->ComputeOffset( index );
+    for ( SizeValueType i = 0; i < runLength; i++ )
+      {
+      out[i] = static_cast<PixelType>( in[i] );
+      }
+
+    // Next row
+    for ( unsigned int d = 1; d < ImageDimension; d++ )
+      {
+      index[d]++;
+      if ( index[d] < start[d] + static_cast<typename IndexType::IndexValueType>( size[d] ) )
+        {
+        break;
+        }
+      index[d] = start[d];
+      }
     }
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::AllocateUpdateBuffer()
 {
   itkDebugMacro( << "AllocateUpdateBuffer() called" ); 
 
-  std::cerr << "AllocateUpdaeBuffer() " << std::endl;
-
   /* The update buffer looks just like the output and holds the change in 
    the pixel  */
   
@@ -185,46 +362,268 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
   m_UpdateBuffer->SetRequestedRegion(output->GetRequestedRegion());
   m_UpdateBuffer->SetBufferedRegion(output->GetBufferedRegion());
   m_UpdateBuffer->Allocate();
+
+  // The semi-implicit solves need the old output until the last axis
+  if ( m_UseSemiImplicitScheme )
+    {
+    m_SemiImplicitBuffer->SetSpacing(output->GetSpacing());
+    m_SemiImplicitBuffer->SetOrigin(output->GetOrigin());
+    m_SemiImplicitBuffer->SetLargestPossibleRegion(output->GetLargestPossibleRegion());
+    m_SemiImplicitBuffer->SetRequestedRegion(output->GetRequestedRegion());
+    m_SemiImplicitBuffer->SetBufferedRegion(output->GetBufferedRegion());
+    m_SemiImplicitBuffer->Allocate();
+    }
+  else
+    {
+    m_SemiImplicitBuffer->Initialize();
+    }
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::AllocateDiffusionTensorImage()
 {
   itkDebugMacro( << "AllocateDiffusionTensorImage() called" ); 
-  
-  std::cerr << "AllocateDiffusionTensorImage() " << std::endl;
-  
 
-  /* The diffusionTensor image has the same size as the output and holds 
-     the diffusion tensor matrix for each pixel */
+  /* The diffusion tensor component images have the same size as the output
+     and each holds one component of the diffusion tensor matrix for each
+     pixel */
 
   typename TOutputImage::Pointer output = this->GetOutput();
 
-  m_DiffusionTensorImage->SetSpacing(output->GetSpacing());
-  m_DiffusionTensorImage->SetOrigin(output->GetOrigin());
-  m_DiffusionTensorImage->SetLargestPossibleRegion(output->GetLargestPossibleRegion());
-  m_DiffusionTensorImage->SetRequestedRegion(output->GetRequestedRegion());
-  m_DiffusionTensorImage->SetBufferedRegion(output->GetBufferedRegion());
-  m_DiffusionTensorImage->Allocate();
+  for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+    {
+    DiffusionTensorComponentImageType * component =
+      m_DiffusionTensorComponentImages[k];
+
+    component->SetSpacing(output->GetSpacing());
+    component->SetOrigin(output->GetOrigin());
+    component->SetLargestPossibleRegion(output->GetLargestPossibleRegion());
+    component->SetRequestedRegion(output->GetRequestedRegion());
+    component->SetBufferedRegion(output->GetBufferedRegion());
+    component->Allocate();
+    }
 }
 
-template<class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
-::ApplyUpdate(TimeStepType dt)
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::FirstTouchBuffers()
 {
-  itkDebugMacro( << "ApplyUpdate Invoked with time step size: " << dt ); 
-  // Set up for multithreaded processing.
+  itkDebugMacro( << "FirstTouchBuffers called" );
+
+  // Deal out the chunks exactly as CalculateChange() and ApplyUpdate() do
   DenseFDThreadStruct str;
   str.Filter = this;
-  str.TimeStep = dt;
-  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
-  this->GetMultiThreader()->SetSingleMethod(this->ApplyUpdateThreaderCallback,
-                                            &str);
+  str.TimeStep = NumericTraits<TimeStepType>::Zero;  // Not used here
+
+  WorkQueueType workQueue;
+  workQueue.Initialize( this->GetOutput()->GetRequestedRegion(),
+                        this->GetNumberOfThreaderThreads(),
+                        m_NumberOfChunksPerThread );
+  str.WorkQueue = &workQueue;
+
   // Multithread the execution
-  this->GetMultiThreader()->SingleMethodExecute();
+  this->ExecuteThreaderCallback( this->FirstTouchBuffersThreaderCallback, &str );
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+ITK_THREAD_RETURN_TYPE
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::FirstTouchBuffersThreaderCallback( void * arg )
+{
+  DenseFDThreadStruct * str;
+  int threadId;
+
+  threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+
+  str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  // Only the own chunks, so each page is touched by its owner
+  ThreadRegionType chunk;
+  while ( str->WorkQueue->GetNextChunk(threadId, chunk, false) )
+    {
+    str->Filter->ThreadedFirstTouchBuffers(chunk, threadId);
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedFirstTouchBuffers(const ThreadRegionType &regionToProcess, int)
+{
+  ImageRegionIterator<OutputImageType> o(this->GetOutput(), regionToProcess);
+  ImageRegionIterator<UpdateBufferType> u(m_UpdateBuffer, regionToProcess);
+  for ( ; !o.IsAtEnd(); ++o, ++u )
+    {
+    o.Set( NumericTraits<PixelType>::Zero );
+    u.Set( NumericTraits<PixelType>::Zero );
+    }
+
+  for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+    {
+    ImageRegionIterator<DiffusionTensorComponentImageType>
+      t(m_DiffusionTensorComponentImages[k], regionToProcess);
+    for ( ; !t.IsAtEnd(); ++t )
+      {
+      t.Set( NumericTraits<TensorValueType>::Zero );
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::SetThreadPool(PersistentThreadPool *pool)
+{
+  if ( pool == 0 )
+    {
+    itkExceptionMacro( << "The thread pool must not be null." );
+    }
+  if ( m_ThreadPool.GetPointer() != pool )
+    {
+    m_ThreadPool = pool;
+    this->Modified();
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+int
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetNumberOfThreaderThreads()
+{
+  if ( m_ThreadPool->IsRunning() )
+    {
+    return m_ThreadPool->GetNumberOfThreads();
+    }
+  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+  return this->GetMultiThreader()->GetNumberOfThreads();
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ExecuteThreaderCallback(ThreadFunctionType callback, void *data)
+{
+  // Time each thread on its way through the callback
+  TimedThreaderStruct timed;
+  timed.Callback = callback;
+  timed.UserData = data;
+  timed.BusyTime = m_ThreadBusyTime;
+  timed.Clock = m_Clock;
+
+  if ( m_ThreadPool->IsRunning() )
+    {
+    m_ThreadPool->Execute( this->TimedThreaderCallback, &timed );
+    }
+  else
+    {
+    this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+    this->GetMultiThreader()->SetSingleMethod( this->TimedThreaderCallback,
+                                               &timed );
+    this->GetMultiThreader()->SingleMethodExecute();
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+ITK_THREAD_RETURN_TYPE
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::TimedThreaderCallback( void * arg )
+{
+  MultiThreader::ThreadInfoStruct * info =
+    (MultiThreader::ThreadInfoStruct *)(arg);
+  TimedThreaderStruct * timed = (TimedThreaderStruct *)(info->UserData);
+
+  // The callback gets the thread information with its own user data
+  MultiThreader::ThreadInfoStruct callbackInfo = *info;
+  callbackInfo.UserData = timed->UserData;
+
+  const RealTimeClock::TimeStampType start = timed->Clock->GetTimeStamp();
+  (*timed->Callback)( &callbackInfo );
+  timed->BusyTime[info->ThreadID] += timed->Clock->GetTimeStamp() - start;
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::BeginPhase(PhaseType phase)
+{
+  m_PhaseStartTime[phase] = m_Clock->GetTimeStamp();
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::EndPhase(PhaseType phase)
+{
+  m_CurrentStatistics.PhaseTime[phase] +=
+    m_Clock->GetTimeStamp() - m_PhaseStartTime[phase];
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+const char *
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetPhaseName(unsigned int phase)
+{
+  switch( phase )
+    {
+    case StructureTensorPhase:
+      return "StructureTensor";
+    case EigenAnalysisPhase:
+      return "EigenAnalysis";
+    case TensorAssemblyPhase:
+      return "TensorAssembly";
+    case CalculateChangePhase:
+      return "CalculateChange";
+    case ApplyUpdatePhase:
+      return "ApplyUpdate";
+    default:
+      return "Unknown";
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ApplyUpdate(TimeStepType dt)
+{
+  itkDebugMacro( << "ApplyUpdate Invoked with time step size: " << dt ); 
+
+  if( m_UseSemiImplicitScheme )
+    {
+    this->ApplySemiImplicitUpdate(dt);
+    }
+  else if( m_UseFusedUpdate )
+    {
+    // CalculateChange() already wrote the updated values to the update
+    // buffer. Swap it with the output; the old output buffer is
+    // overwritten in the next iteration.
+    typename OutputImageType::PixelContainerPointer outputContainer
+      = this->GetOutput()->GetPixelContainer();
+    this->GetOutput()->SetPixelContainer( m_UpdateBuffer->GetPixelContainer() );
+    m_UpdateBuffer->SetPixelContainer( outputContainer );
+    }
+  else
+    {
+    // Set up for multithreaded processing.
+    DenseFDThreadStruct str;
+    str.Filter = this;
+    str.TimeStep = dt;
+
+    WorkQueueType workQueue;
+    workQueue.Initialize( this->GetOutput()->GetRequestedRegion(),
+                          this->GetNumberOfThreaderThreads(),
+                          m_NumberOfChunksPerThread );
+    str.WorkQueue = &workQueue;
+
+    // Multithread the execution
+    this->ExecuteThreaderCallback( this->ApplyUpdateThreaderCallback, &str );
+    }
 
 #ifdef INTERMEDIATE_OUTPUTS
   typedef ImageFileWriter< OutputImageType > WriterType;
@@ -235,49 +634,43 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
 #endif
 }
 
-template<class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 ITK_THREAD_RETURN_TYPE
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::ApplyUpdateThreaderCallback( void * arg )
 {
   DenseFDThreadStruct * str;
-  int total, threadId, threadCount;
+  int threadId;
 
   threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
-  threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
 
   str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
 
-  // Execute the actual method with appropriate output region
-  // first find out how many pieces extent can be split into.
-  // Using the SplitRequestedRegion method from itk::ImageSource.
-  ThreadRegionType splitRegion;
-  total = str->Filter->SplitRequestedRegion(threadId, threadCount,
-                                            splitRegion);
-
-  ThreadDiffusionTensorImageRegionType    splitRegionDiffusionTensorImage;
-  total = str->Filter->SplitRequestedRegion(threadId, threadCount,
-                                            splitRegionDiffusionTensorImage);
-  if (threadId < total)
+  // Execute the actual method on chunks of the output region until the
+  // work queue is empty. The diffusion tensor image has the same grid.
+  ThreadRegionType chunk;
+  while ( str->WorkQueue->GetNextChunk(threadId, chunk) )
     {
-    str->Filter->ThreadedApplyUpdate(str->TimeStep,
-                                     splitRegion, 
-                                     splitRegionDiffusionTensorImage,
-                                     threadId);
+    str->Filter->ThreadedApplyUpdate(str->TimeStep, chunk, chunk, threadId);
     }
 
   return ITK_THREAD_RETURN_VALUE;
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 typename
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>::TimeStepType
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>::TimeStepType
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::CalculateChange()
 {
   itkDebugMacro( << "CalculateChange called" );
 
-  std::cerr << "CalculateChange called" << std::endl;
+  // The semi-implicit scheme computes its right hand side from the output
+  // in ApplyUpdate(), so the stencil is not needed
+  if ( m_UseSemiImplicitScheme )
+    {
+    return m_TimeStep;
+    }
 
   int threadCount;
   TimeStepType dt;
@@ -287,145 +680,740 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
   str.Filter = this;
   str.TimeStep = NumericTraits<TimeStepType>::Zero;  // Not used during the
   // calculate change step.
-  this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
-  this->GetMultiThreader()->SetSingleMethod(this->CalculateChangeThreaderCallback,
-                                            &str);
 
   // Initialize the list of time step values that will be generated by the
   // various threads.  There is one distinct slot for each possible thread,
-  // so this data structure is thread-safe.
-  threadCount = this->GetMultiThreader()->GetNumberOfThreads();  
-  str.TimeStepList = new TimeStepType[threadCount];
-  str.ValidTimeStepList = new bool[threadCount];
+  // so this data structure is thread-safe. The lists are kept between the
+  // iterations.
+  threadCount = this->GetNumberOfThreaderThreads();
+  str.TimeStepList = m_TimeStepList;
+  str.ValidTimeStepList = m_ValidTimeStepList;
+  str.SumOfSquaredUpdateList = m_SumOfSquaredUpdateList;
   for (int i =0; i < threadCount; ++i)
-    {      str.ValidTimeStepList[i] = false;    } 
+    {
+    str.ValidTimeStepList[i] = false;
+    str.SumOfSquaredUpdateList[i] = 0.0;
+    }
+
+  WorkQueueType workQueue;
+  workQueue.Initialize( this->GetOutput()->GetRequestedRegion(), threadCount,
+                        m_NumberOfChunksPerThread );
+  str.WorkQueue = &workQueue;
 
   // Multithread the execution
-  this->GetMultiThreader()->SingleMethodExecute();
+  this->ExecuteThreaderCallback( this->CalculateChangeThreaderCallback, &str );
 
   // Resolve the single value time step to return
   dt = this->ResolveTimeStep(str.TimeStepList, str.ValidTimeStepList, threadCount);
-  delete [] str.TimeStepList;
-  delete [] str.ValidTimeStepList;
+
+  // Reduce the per thread sums to the root mean square change of this
+  // iteration. Halt() compares it with MaximumRMSError.
+  double sumOfSquaredUpdate = 0.0;
+  for (int i = 0; i < threadCount; ++i)
+    {
+    if ( str.ValidTimeStepList[i] )
+      {
+      sumOfSquaredUpdate += str.SumOfSquaredUpdateList[i];
+      }
+    }
+  const double numberOfPixels = static_cast<double>(
+    this->GetOutput()->GetRequestedRegion().GetNumberOfPixels() );
+  if ( numberOfPixels > 0 )
+    {
+    this->SetRMSChange( dt * vcl_sqrt( sumOfSquaredUpdate / numberOfPixels ) );
+    }
 
   return  dt;
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 ITK_THREAD_RETURN_TYPE
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::CalculateChangeThreaderCallback( void * arg )
 {
   DenseFDThreadStruct * str;
-  int total, threadId, threadCount;
+  int threadId;
 
   threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
-  threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
 
   str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
 
-  // Execute the actual method with appropriate output region
-  // first find out how many pieces extent can be split into.
-  // Using the SplitRequestedRegion method from itk::ImageSource.
-  ThreadRegionType splitRegion;
-
-  total = str->Filter->SplitRequestedRegion(threadId, threadCount,
-                                            splitRegion);
-
-  ThreadDiffusionTensorImageRegionType splitDiffusionimageRegion;
-
-  total = str->Filter->SplitRequestedRegion(threadId, threadCount,
-                                            splitDiffusionimageRegion);
-
-  if (threadId < total)
-    { 
+  // Execute the actual method on chunks of the output region until the
+  // work queue is empty. A thread that gets no chunk leaves its time step
+  // invalid.
+  ThreadRegionType chunk;
+  double sumOfSquaredUpdate;
+  while ( str->WorkQueue->GetNextChunk(threadId, chunk) )
+    {
     str->TimeStepList[threadId]
-      = str->Filter->ThreadedCalculateChange(splitRegion, splitDiffusionimageRegion, threadId);
+      = str->Filter->ThreadedCalculateChange(chunk, chunk, sumOfSquaredUpdate,
+                                             threadId);
+    str->SumOfSquaredUpdateList[threadId] += sumOfSquaredUpdate;
     str->ValidTimeStepList[threadId] = true;
     }
 
   return ITK_THREAD_RETURN_VALUE;  
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
-::ThreadedApplyUpdate(TimeStepType dt, const ThreadRegionType &regionToProcess,
-                      const ThreadDiffusionTensorImageRegionType &,
-                      int)
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GenerateDiffusionTensorImage()
 {
-  ImageRegionIterator<UpdateBufferType> u(m_UpdateBuffer,    regionToProcess);
-  ImageRegionIterator<OutputImageType>  o(this->GetOutput(), regionToProcess);
+  itkDebugMacro( << "GenerateDiffusionTensorImage called" );
 
-  u = u.Begin();
-  o = o.Begin();
-
-  while ( !u.IsAtEnd() )
-    {
+  // Set up for multithreaded processing.
+  DenseFDThreadStruct str;
+  str.Filter = this;
+  str.TimeStep = NumericTraits<TimeStepType>::Zero;  // Not used here
 
-    o.Value() += static_cast<PixelType>(u.Value() * dt);  // no adaptor support here
+  // Deal out the chunks exactly as FirstTouchBuffers() does, so each thread
+  // writes the tensors on the pages it placed
+  WorkQueueType workQueue;
+  workQueue.Initialize( this->GetOutput()->GetRequestedRegion(),
+                        this->GetNumberOfThreaderThreads(),
+                        m_NumberOfChunksPerThread );
+  str.WorkQueue = &workQueue;
 
-    ++o;
-    ++u;
-    }
+  // Multithread the execution
+  this->BeginPhase( TensorAssemblyPhase );
+  this->ExecuteThreaderCallback(
+    this->GenerateDiffusionTensorImageThreaderCallback, &str );
+  this->EndPhase( TensorAssemblyPhase );
 }
 
-template <class TInputImage, class TOutputImage>
-typename
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>::TimeStepType
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
-::ThreadedCalculateChange(const ThreadRegionType &regionToProcess, 
-    const ThreadDiffusionTensorImageRegionType & diffusionRegionToProcess, int)
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+ITK_THREAD_RETURN_TYPE
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GenerateDiffusionTensorImageThreaderCallback( void * arg )
 {
-  typedef typename OutputImageType::RegionType      RegionType;
-  typedef typename OutputImageType::SizeType        SizeType;
-  typedef typename OutputImageType::SizeValueType   SizeValueType;
-  typedef typename OutputImageType::IndexType       IndexType;
-  typedef typename OutputImageType::IndexValueType  IndexValueType;
+  DenseFDThreadStruct * str;
+  int threadId;
 
-  typedef typename FiniteDifferenceFunctionType::NeighborhoodType
-                                           NeighborhoodIteratorType;
-  
-  typedef ImageRegionIterator<UpdateBufferType> UpdateIteratorType;
+  threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
 
-  typename OutputImageType::Pointer output = this->GetOutput();
-  TimeStepType timeStep;
-  void *globalData;
+  str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
 
-  // Get the FiniteDifferenceFunction to use in calculations.
-  const typename FiniteDifferenceFunctionType::Pointer df = 
-     dynamic_cast<AnisotropicDiffusionTensorFunction<UpdateBufferType> *>
-     ( this->GetDifferenceFunction().GetPointer());
+  // Only the own chunks, so the tensors are written by the thread that
+  // first touched their pages
+  ThreadDiffusionTensorImageRegionType chunk;
+  while ( str->WorkQueue->GetNextChunk(threadId, chunk, false) )
+    {
+    str->Filter->ThreadedGenerateDiffusionTensorImage(chunk, threadId);
+    }
 
-  const SizeType  radius = df->GetRadius();
-  
-  // Break the input into a series of regions.  The first region is free
-  // of boundary conditions, the rest with boundary conditions.  We operate
-  // on the output region because input has been copied to output.
-  typedef NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<OutputImageType>
-                                                        FaceCalculatorType;
+  return ITK_THREAD_RETURN_VALUE;
+}
 
-  typedef typename FaceCalculatorType::FaceListType FaceListType;
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedGenerateDiffusionTensorImage(
+                      const ThreadDiffusionTensorImageRegionType &, int)
+{
+}
 
-  FaceCalculatorType faceCalculator;
-    
-  FaceListType faceList = faceCalculator(output, regionToProcess, radius);
-  typename FaceListType::iterator fIt = faceList.begin();
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ApplySemiImplicitUpdate(TimeStepType dt)
+{
+  itkDebugMacro( << "ApplySemiImplicitUpdate called" );
+
+  // Set up for multithreaded processing.
+  DenseFDThreadStruct str;
+  str.Filter = this;
+  str.TimeStep = dt;
+
+  const int threadCount = this->GetNumberOfThreaderThreads();
+  str.SumOfSquaredUpdateList = m_SumOfSquaredUpdateList;
+  for (int i = 0; i < threadCount; ++i)
+    {
+    str.SumOfSquaredUpdateList[i] = 0.0;
+    }
+
+  this->ExecuteThreaderCallback(
+    this->SemiImplicitRightHandSideThreaderCallback, &str );
+
+  // The lines of different axes cross, so the axes are solved one after
+  // the other. The output keeps the old image until the end.
+  for( unsigned int axis = 0; axis < ImageDimension; axis++ )
+    {
+    str.Axis = axis;
+    this->ExecuteThreaderCallback(
+      this->SemiImplicitSolveThreaderCallback, &str );
+    }
+
+  double sumOfSquaredChange = 0.0;
+  for (int i = 0; i < threadCount; ++i)
+    {
+    sumOfSquaredChange += str.SumOfSquaredUpdateList[i];
+    }
+
+  // The semi-implicit buffer holds the new image. Swap it with the output,
+  // as in the fused update.
+  typename OutputImageType::PixelContainerPointer outputContainer
+    = this->GetOutput()->GetPixelContainer();
+  this->GetOutput()->SetPixelContainer(
+    m_SemiImplicitBuffer->GetPixelContainer() );
+  m_SemiImplicitBuffer->SetPixelContainer( outputContainer );
+
+  // The change the solves applied, not the one of the explicit stencil
+  const double numberOfPixels = static_cast<double>(
+    this->GetOutput()->GetRequestedRegion().GetNumberOfPixels() );
+  if ( numberOfPixels > 0 )
+    {
+    this->SetRMSChange( vcl_sqrt( sumOfSquaredChange / numberOfPixels ) );
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+ITK_THREAD_RETURN_TYPE
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::SemiImplicitRightHandSideThreaderCallback( void * arg )
+{
+  DenseFDThreadStruct * str;
+  int total, threadId, threadCount;
+
+  threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  ThreadRegionType splitRegion;
+  total = str->Filter->SplitRequestedRegion(threadId, threadCount,
+                                            splitRegion);
+  if (threadId < total)
+    {
+    str->Filter->ThreadedComputeSemiImplicitRightHandSide(str->TimeStep,
+                                                          splitRegion,
+                                                          threadId);
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+ITK_THREAD_RETURN_TYPE
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::SemiImplicitSolveThreaderCallback( void * arg )
+{
+  DenseFDThreadStruct * str;
+  int total, threadId, threadCount;
+
+  threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  // Each thread gets whole lines along the axis being solved
+  ThreadRegionType splitRegion;
+  total = str->Filter->SplitRequestedRegionAcrossAxis(threadId, threadCount,
+                                                      str->Axis, splitRegion);
+  if (threadId < total)
+    {
+    str->Filter->ThreadedSolveSemiImplicitAxis(str->TimeStep, str->Axis,
+                                               splitRegion, threadId,
+                                               str->SumOfSquaredUpdateList[threadId]);
+    }
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+int
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::SplitRequestedRegionAcrossAxis(int i, int num, unsigned int axis,
+                                 ThreadRegionType &splitRegion)
+{
+  const ThreadRegionType & requestedRegion =
+    this->GetOutput()->GetRequestedRegion();
+
+  typename ThreadRegionType::IndexType splitIndex = requestedRegion.GetIndex();
+  typename ThreadRegionType::SizeType  splitSize  = requestedRegion.GetSize();
+
+  splitRegion = requestedRegion;
+
+  // Split along the outermost axis, other than axis, that can be split
+  int splitAxis = -1;
+  for( int d = ImageDimension - 1; d >= 0; d-- )
+    {
+    if( static_cast<unsigned int>( d ) != axis && splitSize[d] > 1 )
+      {
+      splitAxis = d;
+      break;
+      }
+    }
+  if( splitAxis < 0 )
+    {
+    return 1;
+    }
+
+  const int range = static_cast<int>( splitSize[splitAxis] );
+  const int valuesPerThread = (int)vcl_ceil( range / (double)num );
+  const int maxThreadIdUsed = (int)vcl_ceil( range / (double)valuesPerThread ) - 1;
+
+  if( i < maxThreadIdUsed )
+    {
+    splitIndex[splitAxis] += i * valuesPerThread;
+    splitSize[splitAxis] = valuesPerThread;
+    }
+  if( i == maxThreadIdUsed )
+    {
+    splitIndex[splitAxis] += i * valuesPerThread;
+    splitSize[splitAxis] = splitSize[splitAxis] - i * valuesPerThread;
+    }
+
+  splitRegion.SetIndex( splitIndex );
+  splitRegion.SetSize( splitSize );
+
+  return maxThreadIdUsed + 1;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedComputeSemiImplicitRightHandSide(TimeStepType dt,
+                      const ThreadRegionType &regionToProcess,
+                      int)
+{
+  typedef typename OutputImageType::IndexType       IndexType;
+  typedef typename OutputImageType::OffsetValueType OffsetValueType;
+
+  // Component image of the diffusion tensor element (i,j)
+  static const unsigned int component[3][3] = { { 0, 1, 2 },
+                                                { 1, 3, 4 },
+                                                { 2, 4, 5 } };
+
+  OutputImageType * output = this->GetOutput();
+
+  const PixelType * u = output->GetBufferPointer();
+  PixelType * r = m_UpdateBuffer->GetBufferPointer();
+
+  const TensorValueType * tensor[NumberOfDiffusionTensorComponents];
+  for( unsigned int c = 0; c < NumberOfDiffusionTensorComponents; c++ )
+    {
+    tensor[c] = m_DiffusionTensorComponentImages[c]->GetBufferPointer();
+    }
+
+  const OffsetValueType * offsetTable = output->GetOffsetTable();
+  const IndexType firstIndex = output->GetBufferedRegion().GetIndex();
+  IndexType lastIndex;
+  for( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    lastIndex[i] = firstIndex[i] + static_cast<typename IndexType::IndexValueType>(
+      output->GetBufferedRegion().GetSize()[i] ) - 1;
+    }
+
+  ImageRegionConstIteratorWithIndex<OutputImageType> it(output, regionToProcess);
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const IndexType index = it.GetIndex();
+    const OffsetValueType p = output->ComputeOffset( index );
+
+    // A neighbor outside the image is replaced by the pixel itself, as in
+    // the stencil
+    OffsetValueType down[ImageDimension];
+    OffsetValueType up[ImageDimension];
+    for( unsigned int i = 0; i < ImageDimension; i++ )
+      {
+      down[i] = ( index[i] > firstIndex[i] ) ? offsetTable[i] : 0;
+      up[i]   = ( index[i] < lastIndex[i] )  ? offsetTable[i] : 0;
+      }
+
+    // The mixed derivative terms of the stencil, D_ij d_ij u and
+    // ( d_i D_ij ) d_j u for i != j. The terms with i == j are the
+    // diffusion along the axes, which the solves take implicitly.
+    double mixed = 0.0;
+    for( unsigned int i = 0; i < ImageDimension; i++ )
+      {
+      for( unsigned int j = 0; j < ImageDimension; j++ )
+        {
+        if( i == j )
+          {
+          continue;
+          }
+        const TensorValueType * d = tensor[ component[i][j] ];
+
+        const double dij = 0.25 * ( u[p - down[i] - down[j]]
+                                  - u[p - down[i] + up[j]]
+                                  - u[p + up[i] - down[j]]
+                                  + u[p + up[i] + up[j]] );
+        const double dj  = 0.5 * ( u[p + up[j]] - u[p - down[j]] );
+        const double ddi = 0.5 * ( d[p + up[i]] - d[p - down[i]] );
+
+        mixed += d[p] * dij + ddi * dj;
+        }
+      }
+
+    r[p] = static_cast<PixelType>( u[p] + dt * mixed );
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedSolveSemiImplicitAxis(TimeStepType dt, unsigned int axis,
+                      const ThreadRegionType &regionToProcess,
+                      int, double &sumOfSquaredChange)
+{
+  typedef typename OutputImageType::OffsetValueType OffsetValueType;
+  typedef typename OutputImageType::SizeValueType   SizeValueType;
+
+  // Index of the diagonal tensor component of each axis
+  static const unsigned int diagonal[3] = { 0, 3, 5 };
+
+  OutputImageType * output = this->GetOutput();
+
+  const PixelType * u = output->GetBufferPointer();
+  const PixelType * r = m_UpdateBuffer->GetBufferPointer();
+  PixelType * v = m_SemiImplicitBuffer->GetBufferPointer();
+  const TensorValueType * diffusion =
+    m_DiffusionTensorComponentImages[ diagonal[axis] ]->GetBufferPointer();
+
+  const OffsetValueType stride = output->GetOffsetTable()[axis];
+  const SizeValueType   length = regionToProcess.GetSize()[axis];
+
+  const double scale  = ImageDimension * dt;
+  const double weight = 1.0 / ImageDimension;
+  const bool   firstAxis = ( axis == 0 );
+  const bool   lastAxis  = ( axis == ImageDimension - 1 );
+
+  std::vector<double> lower( length );
+  std::vector<double> diag( length );
+  std::vector<double> upper( length );
+  std::vector<double> x( length );
+
+  // Visit the first pixel of every line of the region
+  ThreadRegionType lineStarts = regionToProcess;
+  typename ThreadRegionType::SizeType lineStartsSize = lineStarts.GetSize();
+  lineStartsSize[axis] = 1;
+  lineStarts.SetSize( lineStartsSize );
+
+  ImageRegionConstIteratorWithIndex<OutputImageType> it(output, lineStarts);
+  for( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const OffsetValueType start = output->ComputeOffset( it.GetIndex() );
+
+    // Build ( I - m dt A_axis ) with zero flux at both ends of the line
+    for( SizeValueType k = 0; k < length; k++ )
+      {
+      const OffsetValueType p = start + static_cast<OffsetValueType>( k ) * stride;
+
+      const double gDown = ( k > 0 )
+        ? 0.5 * ( diffusion[p] + diffusion[p - stride] ) : 0.0;
+      const double gUp   = ( k + 1 < length )
+        ? 0.5 * ( diffusion[p] + diffusion[p + stride] ) : 0.0;
+
+      lower[k] = -scale * gDown;
+      upper[k] = -scale * gUp;
+      diag[k]  = 1.0 + scale * ( gDown + gUp );
+      x[k]     = r[p];
+      }
+
+    // Thomas algorithm. The matrix is diagonally dominant, so no pivoting
+    // is needed.
+    for( SizeValueType k = 1; k < length; k++ )
+      {
+      const double m = lower[k] / diag[k-1];
+      diag[k] -= m * upper[k-1];
+      x[k]    -= m * x[k-1];
+      }
+    x[length-1] /= diag[length-1];
+    for( SizeValueType k = length - 1; k > 0; k-- )
+      {
+      x[k-1] = ( x[k-1] - upper[k-1] * x[k] ) / diag[k-1];
+      }
+
+    for( SizeValueType k = 0; k < length; k++ )
+      {
+      const OffsetValueType p = start + static_cast<OffsetValueType>( k ) * stride;
+      if( firstAxis )
+        {
+        v[p] = static_cast<PixelType>( weight * x[k] );
+        }
+      else
+        {
+        v[p] += static_cast<PixelType>( weight * x[k] );
+        }
+      if( lastAxis )
+        {
+        const double change = static_cast<double>( v[p] ) - u[p];
+        sumOfSquaredChange += change * change;
+        }
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ApplyTemporalBlock(unsigned int numberOfSteps)
+{
+  itkDebugMacro( << "ApplyTemporalBlock called for " << numberOfSteps
+                 << " steps" );
+
+  // Set up for multithreaded processing.
+  DenseFDThreadStruct str;
+  str.Filter = this;
+  str.TimeStep = NumericTraits<TimeStepType>::Zero;  // Not used here
+  str.NumberOfSteps = numberOfSteps;
+
+  const int threadCount = this->GetNumberOfThreaderThreads();
+  str.SumOfSquaredUpdateList = m_SumOfSquaredUpdateList;
+  for (int i = 0; i < threadCount; ++i)
+    {
+    str.SumOfSquaredUpdateList[i] = 0.0;
+    }
+
+  // Multithread the execution
+  this->ExecuteThreaderCallback( this->TemporalBlockThreaderCallback, &str );
+
+  double sumOfSquaredChange = 0.0;
+  for (int i = 0; i < threadCount; ++i)
+    {
+    sumOfSquaredChange += str.SumOfSquaredUpdateList[i];
+    }
+
+  // The update buffer holds the image after the block. Swap it with the
+  // output, as in the fused update.
+  typename OutputImageType::PixelContainerPointer outputContainer
+    = this->GetOutput()->GetPixelContainer();
+  this->GetOutput()->SetPixelContainer( m_UpdateBuffer->GetPixelContainer() );
+  m_UpdateBuffer->SetPixelContainer( outputContainer );
+
+  // Report the mean change per iteration
+  const double numberOfPixels = static_cast<double>(
+    this->GetOutput()->GetRequestedRegion().GetNumberOfPixels() );
+  if ( numberOfPixels > 0 )
+    {
+    this->SetRMSChange(
+      vcl_sqrt( sumOfSquaredChange / numberOfPixels ) / numberOfSteps );
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+ITK_THREAD_RETURN_TYPE
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::TemporalBlockThreaderCallback( void * arg )
+{
+  DenseFDThreadStruct * str;
+  int threadId, threadCount;
+
+  threadId = ((MultiThreader::ThreadInfoStruct *)(arg))->ThreadID;
+  threadCount = ((MultiThreader::ThreadInfoStruct *)(arg))->NumberOfThreads;
+
+  str = (DenseFDThreadStruct *)(((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+
+  // The threads take the tiles in turn
+  str->Filter->ThreadedApplyTemporalBlock(str->NumberOfSteps, threadId,
+                                          threadCount,
+                                          str->SumOfSquaredUpdateList[threadId]);
+
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedApplyTemporalBlock(unsigned int numberOfSteps, int threadId,
+                             int threadCount, double &sumOfSquaredChange)
+{
+  typedef typename ThreadRegionType::IndexValueType IndexValueType;
+  typedef typename ThreadRegionType::SizeValueType  SizeValueType;
+
+  const OutputImageType * output = this->GetOutput();
+  const ThreadRegionType & requestedRegion = output->GetRequestedRegion();
+  const ThreadRegionType & bufferedRegion = output->GetBufferedRegion();
+
+  // The tiles cover the last two axes. The rows along the first axis are
+  // kept whole for the row kernel.
+  const unsigned int axisA = ImageDimension - 2;
+  const unsigned int axisB = ImageDimension - 1;
+
+  const SizeValueType tileSize = m_TemporalTileSize;
+  const SizeValueType numberOfTilesA =
+    ( requestedRegion.GetSize()[axisA] + tileSize - 1 ) / tileSize;
+  const SizeValueType numberOfTilesB =
+    ( requestedRegion.GetSize()[axisB] + tileSize - 1 ) / tileSize;
+  const SizeValueType numberOfTiles = numberOfTilesA * numberOfTilesB;
+
+  // Ping-pong images for the tile and its halo. Allocate() keeps the
+  // memory when the next tile is not larger.
+  typename OutputImageType::Pointer tileInput = OutputImageType::New();
+  typename OutputImageType::Pointer tileOutput = OutputImageType::New();
+
+  double sumOfSquaredUpdate;
+  sumOfSquaredChange = 0.0;
+
+  for ( SizeValueType tile = threadId; tile < numberOfTiles; tile += threadCount )
+    {
+    const SizeValueType tileA = tile % numberOfTilesA;
+    const SizeValueType tileB = tile / numberOfTilesA;
+
+    // The pixels this tile produces
+    ThreadRegionType core = requestedRegion;
+    typename ThreadRegionType::IndexType coreIndex = core.GetIndex();
+    typename ThreadRegionType::SizeType  coreSize  = core.GetSize();
+    coreIndex[axisA] += static_cast<IndexValueType>( tileA * tileSize );
+    coreIndex[axisB] += static_cast<IndexValueType>( tileB * tileSize );
+    coreSize[axisA] = vnl_math_min( tileSize,
+      requestedRegion.GetSize()[axisA] - tileA * tileSize );
+    coreSize[axisB] = vnl_math_min( tileSize,
+      requestedRegion.GetSize()[axisB] - tileB * tileSize );
+    core.SetIndex( coreIndex );
+    core.SetSize( coreSize );
+
+    // Each step only reads the direct neighbors, so a halo of one pixel per
+    // step keeps the core exact. The halo pixels themselves go wrong from
+    // the outside in and are thrown away.
+    ThreadRegionType padded = core;
+    padded.PadByRadius( numberOfSteps );
+    padded.Crop( bufferedRegion );
+
+    tileInput->SetRegions( padded );
+    tileInput->Allocate();
+    tileOutput->SetRegions( padded );
+    tileOutput->Allocate();
+
+    ImageRegionConstIterator<OutputImageType> in( output, padded );
+    ImageRegionIterator<OutputImageType>      out( tileInput, padded );
+    for ( ; !in.IsAtEnd(); ++in, ++out )
+      {
+      out.Set( in.Get() );
+      }
+
+    for ( unsigned int step = 0; step < numberOfSteps; step++ )
+      {
+      this->CalculateChangeOverRegion( tileInput, tileOutput, padded, true,
+                                       sumOfSquaredUpdate );
+      std::swap( tileInput, tileOutput );
+      }
+
+    // Write the core to the update buffer
+    ImageRegionConstIterator<OutputImageType> tileIt( tileInput, core );
+    ImageRegionConstIterator<OutputImageType> oldIt( output, core );
+    ImageRegionIterator<UpdateBufferType>     newIt( m_UpdateBuffer, core );
+    for ( ; !tileIt.IsAtEnd(); ++tileIt, ++oldIt, ++newIt )
+      {
+      const double change =
+        static_cast<double>( tileIt.Get() ) - static_cast<double>( oldIt.Get() );
+      sumOfSquaredChange += change * change;
+      newIt.Set( tileIt.Get() );
+      }
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedApplyUpdate(TimeStepType dt, const ThreadRegionType &regionToProcess,
+                      const ThreadDiffusionTensorImageRegionType &,
+                      int)
+{
+  ImageRegionIterator<UpdateBufferType> u(m_UpdateBuffer,    regionToProcess);
+  ImageRegionIterator<OutputImageType>  o(this->GetOutput(), regionToProcess);
+
+  u = u.Begin();
+  o = o.Begin();
+
+  while ( !u.IsAtEnd() )
+    {
+
+    o.Value() += static_cast<PixelType>(u.Value() * dt);  // no adaptor support here
+
+    ++o;
+    ++u;
+    }
+}
 
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+typename
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>::TimeStepType
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedCalculateChange(const ThreadRegionType &regionToProcess, 
+    const ThreadDiffusionTensorImageRegionType &, double &sumOfSquaredUpdate,
+    int)
+{
+  // In the fused mode the update buffer receives u + dt * update. The time
+  // step is fixed, so it is known before the sweep.
+  const bool fused = m_UseFusedUpdate && !m_UseSemiImplicitScheme;
 
-  typedef NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<DiffusionTensorImageType>
-    DiffusionTensorFaceCalculatorType;
+  return this->CalculateChangeOverRegion( this->GetOutput(), m_UpdateBuffer,
+                                          regionToProcess, fused,
+                                          sumOfSquaredUpdate );
+}
 
-  typedef typename DiffusionTensorFaceCalculatorType::FaceListType 
-                                                DiffusionTensorFaceListType;
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+typename
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>::TimeStepType
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::CalculateChangeOverRegion(const OutputImageType *input,
+                            UpdateBufferType *output,
+                            const ThreadRegionType &regionToProcess,
+                            bool addToInput,
+                            double &sumOfSquaredUpdate)
+{
+  typedef typename OutputImageType::RegionType      RegionType;
+  typedef typename OutputImageType::SizeType        SizeType;
+  typedef typename OutputImageType::SizeValueType   SizeValueType;
+  typedef typename OutputImageType::IndexType       IndexType;
+  typedef typename OutputImageType::IndexValueType  IndexValueType;
 
-  DiffusionTensorFaceCalculatorType diffusionTensorFaceCalculator;
+  typedef typename FiniteDifferenceFunctionType::NeighborhoodType
+                                           NeighborhoodIteratorType;
   
-  DiffusionTensorFaceListType diffusionTensorFaceList = 
-     diffusionTensorFaceCalculator(m_DiffusionTensorImage, diffusionRegionToProcess, radius);
+  typedef ImageRegionIterator<UpdateBufferType> UpdateIteratorType;
+
+  TimeStepType timeStep;
+  void *globalData;
 
-  typename DiffusionTensorFaceListType::iterator dfIt = diffusionTensorFaceList.begin();
+  // Get the FiniteDifferenceFunction to use in calculations.
+  const typename FiniteDifferenceFunctionType::Pointer df = 
+     dynamic_cast<AnisotropicDiffusionTensorFunction<UpdateBufferType, TTensorValueType> *>
+     ( this->GetDifferenceFunction().GetPointer());
+
+  const SizeType  radius = df->GetRadius();
   
+  // Break the input into a series of regions.  The first region is free
+  // of boundary conditions, the rest with boundary conditions.
+  typedef NeighborhoodAlgorithm::ImageBoundaryFacesCalculator<OutputImageType>
+                                                        FaceCalculatorType;
+
+  typedef typename FaceCalculatorType::FaceListType FaceListType;
+
+  FaceCalculatorType faceCalculator;
+    
+  FaceListType faceList = faceCalculator(input, regionToProcess, radius);
+  typename FaceListType::iterator fIt = faceList.begin();
+
+  // The diffusion tensor components are read straight from their buffers.
+  // The stencil only uses the neighbors along the axes; the distance to a
+  // neighbor outside the image is 0, which is the zero flux Neumann
+  // condition the intensity neighborhood uses.
+  typedef typename FiniteDifferenceFunctionType::OffsetValueType OffsetValueType;
+
+  const DiffusionTensorComponentImageType * tensorImage =
+    m_DiffusionTensorComponentImages[0];
+
+  const TensorValueType * tensorBuffers[NumberOfDiffusionTensorComponents];
+  for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+    {
+    tensorBuffers[k] = m_DiffusionTensorComponentImages[k]->GetBufferPointer();
+    }
+
+  const OffsetValueType * offsetTable = tensorImage->GetOffsetTable();
+  const OffsetValueType * inputOffsetTable = input->GetOffsetTable();
+  const ThreadDiffusionTensorImageRegionType & tensorRegion =
+    tensorImage->GetBufferedRegion();
+
+  IndexType firstIndex = tensorRegion.GetIndex();
+  IndexType lastIndex;
+  for( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    lastIndex[i] = firstIndex[i]
+      + static_cast<IndexValueType>( tensorRegion.GetSize()[i] ) - 1;
+    }
 
   // Ask the function object for a pointer to a data structure it
   // will use to manage any global values it needs.  We'll pass this
@@ -434,44 +1422,82 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
   // time step for this iteration.
   globalData = df->GetGlobalDataPointer();
 
-  // Process the non-boundary region.
-  NeighborhoodIteratorType nD(radius, output, *fIt);
-  UpdateIteratorType       nU(m_UpdateBuffer,  *fIt);
-  DiffusionTensorNeighborhoodType  dTN(radius,m_DiffusionTensorImage, *dfIt); 
+  const TimeStepType dt = df->GetTimeStep();
+
+  sumOfSquaredUpdate = 0.0;
+
+  const TensorValueType * tensor[NumberOfDiffusionTensorComponents];
+  OffsetValueType strideDown[ImageDimension];
+  OffsetValueType strideUp[ImageDimension];
 
-  nD.GoToBegin();
-  nU.GoToBegin();
-  dTN.GoToBegin();
-  while( !nD.IsAtEnd() )
+  // Process the non-boundary region a row at a time straight from the
+  // buffers. The buffers must have the same extent along the first axis.
+  const typename OutputImageType::RegionType & interiorRegion = *fIt;
+  const SizeType interiorSize = interiorRegion.GetSize();
+  if( interiorRegion.GetNumberOfPixels() > 0 )
     {
-    nU.Value() = df->ComputeUpdate(nD, dTN, globalData);
-    ++nD;
-    ++nU;
-    ++dTN;
+    const PixelType * inBuffer = input->GetBufferPointer();
+    PixelType * outBuffer = output->GetBufferPointer();
+
+    IndexType rowIndex = interiorRegion.GetIndex();
+    for( SizeValueType z = 0; z < interiorSize[2]; z++ )
+      {
+      rowIndex[2] = interiorRegion.GetIndex()[2] + static_cast<IndexValueType>( z );
+      for( SizeValueType y = 0; y < interiorSize[1]; y++ )
+        {
+        rowIndex[1] = interiorRegion.GetIndex()[1] + static_cast<IndexValueType>( y );
+
+        const OffsetValueType offset = tensorImage->ComputeOffset( rowIndex );
+        for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+          {
+          tensor[k] = tensorBuffers[k] + offset;
+          }
+        sumOfSquaredUpdate += df->ComputeUpdateRow(
+          inBuffer + input->ComputeOffset( rowIndex ), tensor,
+          inputOffsetTable, offsetTable, interiorSize[0], addToInput, dt,
+          outBuffer + output->ComputeOffset( rowIndex ) );
+        }
+      }
     }
 
   // Process each of the boundary faces.
-  NeighborhoodIteratorType bD;
-  DiffusionTensorNeighborhoodType bDD;
-  UpdateIteratorType   bU;
-  ++dfIt;
-  for (++fIt; fIt != faceList.end(); ++fIt)
-    {
-    bD = NeighborhoodIteratorType(radius, output, *fIt);
-    bDD = DiffusionTensorNeighborhoodType(radius, m_DiffusionTensorImage, *dfIt);
-    bU = UpdateIteratorType  (m_UpdateBuffer, *fIt);
-     
-    bD.GoToBegin();
-    bU.GoToBegin();
-    bDD.GoToBegin();
-    while ( !bD.IsAtEnd() )
+  for( ++fIt; fIt != faceList.end(); ++fIt )
+    {
+    NeighborhoodIteratorType nD(radius, input, *fIt);
+    UpdateIteratorType       nU(output, *fIt);
+
+    nD.GoToBegin();
+    nU.GoToBegin();
+    while( !nD.IsAtEnd() )
       {
-      bU.Value() = df->ComputeUpdate(bD,bDD,globalData);
-      ++bD;
-      ++bU;
-      ++bDD;
+      const IndexType index = nD.GetIndex();
+      const OffsetValueType offset = tensorImage->ComputeOffset( index );
+
+      for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+        {
+        tensor[k] = tensorBuffers[k] + offset;
+        }
+      for( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        strideDown[i] = ( index[i] > firstIndex[i] ) ? offsetTable[i] : 0;
+        strideUp[i]   = ( index[i] < lastIndex[i] )  ? offsetTable[i] : 0;
+        }
+
+      const PixelType update =
+        df->ComputeUpdate(nD, tensor, strideDown, strideUp, globalData);
+      sumOfSquaredUpdate += static_cast<double>( update ) * update;
+
+      if( addToInput )
+        {
+        nU.Value() = nD.GetCenterPixel() + static_cast<PixelType>( update * dt );
+        }
+      else
+        {
+        nU.Value() = update;
+        }
+      ++nD;
+      ++nU;
       }
-    ++dfIt;
     }
 
   // Ask the finite difference function to compute the time step for
@@ -483,80 +1509,318 @@ AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
   return timeStep;
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::GenerateData()
 {
   itkDebugMacro( << "GenerateData is called" );
 
-  if (this->GetState() == Superclass::UNINITIALIZED)
+  // Keep one set of worker threads for all the parallel sections of the
+  // run. A pool that is already running belongs to the caller.
+  const bool startThreadPool = !m_ThreadPool->IsRunning();
+  if ( startThreadPool )
     {
+    m_ThreadPool->SetPinThreads( m_PinThreads );
+    m_ThreadPool->Start( this->GetNumberOfThreads() );
+    }
+
+  try
+    {
+    if (this->GetState() == Superclass::UNINITIALIZED)
+      {
+
+      // Allocate the output image
+      this->AllocateOutputs();
 
-    // Allocate the output image
-    this->AllocateOutputs();
+      // Allocate the internal update buffer.  
+      this->AllocateUpdateBuffer();
 
-    // Copy the input image to the output image.  Algorithms will operate
-    // directly on the output image and the update buffer.
-    this->CopyInputToOutput();
+      // Allocate buffer for the diffusion tensor image
+      this->AllocateDiffusionTensorImage();
 
-    // Allocate the internal update buffer.  
-    this->AllocateUpdateBuffer();
+      // Let the threads place the pages of the buffers before anything else
+      // writes to them
+      if ( m_UseFirstTouchAllocation )
+        {
+        this->FirstTouchBuffers();
+        }
 
-    // Allocate buffer for the diffusion tensor image
-    this->AllocateDiffusionTensorImage();
+      // Copy the input image to the output image.  Algorithms will operate
+      // directly on the output image and the update buffer.
+      this->CopyInputToOutput();
 
-    this->SetStateToInitialized();
+      // The input may have been regenerated in the same pixel container, so
+      // always set the input buffer image up again. This also marks it as
+      // modified for the internal pipelines.
+      typename InputImageType::ConstPointer input = this->GetInput();
+      m_InputBufferImage->CopyInformation( input );
+      m_InputBufferImage->SetRegions( input->GetBufferedRegion() );
+      m_InputBufferImage->SetPixelContainer(
+        const_cast< typename InputImageType::PixelContainer * >(
+          input->GetPixelContainer() ) );
 
-    this->SetElapsedIterations( 0 );
-    }
-    
-  // Iterative algorithm
-  TimeStepType dt;
-  unsigned int iter = 0;
+      this->SetStateToInitialized();
 
-  while ( ! this->Halt() )
-    {
-    std::cout << "Iteration:\t" << iter << std::endl;
-    this->InitializeIteration(); // An optional method for precalculating
-                                 // global values, or otherwise setting up
-                                 // for the next iteration
-    dt = this->CalculateChange();
+      this->SetElapsedIterations( 0 );
 
-    this->ApplyUpdate(dt);
+      m_IterationStatistics.clear();
+      }
 
-    ++iter;
+    // Iterative algorithm
+    TimeStepType dt;
+    unsigned int iter = 0;
 
-    this->SetElapsedIterations( iter );
+    // The input and the buffers do not change size during the run
+    const double bytesAllocated = this->GetNumberOfBytesPerPixel()
+      * this->GetOutput()->GetBufferedRegion().GetNumberOfPixels();
+    const int numberOfThreads = this->GetNumberOfThreaderThreads();
 
-    // Invoke the iteration event.
-    this->InvokeEvent( IterationEvent() );
-    if( this->GetAbortGenerateData() )
+    while ( ! this->Halt() )
       {
+      for( unsigned int p = 0; p < NumberOfPhases; p++ )
+        {
+        m_CurrentStatistics.PhaseTime[p] = 0.0;
+        }
+      for( int i = 0; i < numberOfThreads; i++ )
+        {
+        m_ThreadBusyTime[i] = 0.0;
+        }
+      const unsigned int firstIteration = iter;
+
+      this->InitializeIteration(); // An optional method for precalculating
+                                   // global values, or otherwise setting up
+                                   // for the next iteration
+
+      // Advance several iterations on one tile at a time with the diffusion
+      // tensor image frozen
+      const unsigned int remainingIterations =
+        this->GetNumberOfIterations() - iter;
+      if ( m_TemporalBlockSize > 1 && !m_UseSemiImplicitScheme
+           && remainingIterations > 1 )
+        {
+        const unsigned int steps =
+          vnl_math_min( m_TemporalBlockSize, remainingIterations );
+        this->BeginPhase( CalculateChangePhase );
+        this->ApplyTemporalBlock( steps );
+        this->EndPhase( CalculateChangePhase );
+        iter += steps;
+        }
+      else
+        {
+        this->BeginPhase( CalculateChangePhase );
+        dt = this->CalculateChange();
+        this->EndPhase( CalculateChangePhase );
+
+        this->BeginPhase( ApplyUpdatePhase );
+        this->ApplyUpdate(dt);
+        this->EndPhase( ApplyUpdatePhase );
+
+        ++iter;
+        }
+
+      this->SetElapsedIterations( iter );
+
+      // Record the statistics of the iteration
+      m_CurrentStatistics.Iteration = iter;
+      m_CurrentStatistics.NumberOfSteps = iter - firstIteration;
+      m_CurrentStatistics.ThreadBusyTime.assign( m_ThreadBusyTime,
+        m_ThreadBusyTime + numberOfThreads );
+      m_CurrentStatistics.BytesAllocated = bytesAllocated;
+      m_CurrentStatistics.RMSChange = this->GetRMSChange();
+      m_IterationStatistics.push_back( m_CurrentStatistics );
+
+      if ( m_Verbose )
+        {
+        std::cout << "Iteration:\t" << iter
+                  << "\tRMSChange:\t" << m_CurrentStatistics.RMSChange
+                  << "\tDiffusionTensorUpdated:\t"
+                  << m_CurrentStatistics.DiffusionTensorUpdated;
+        for( unsigned int p = 0; p < NumberOfPhases; p++ )
+          {
+          std::cout << "\t" << GetPhaseName( p ) << ":\t"
+                    << m_CurrentStatistics.PhaseTime[p];
+          }
+        std::cout << std::endl;
+        }
+
+      // Invoke the iteration event.
       this->InvokeEvent( IterationEvent() );
-      this->ResetPipeline(); 
-      throw ProcessAborted(__FILE__,__LINE__);
+      this->InvokeEvent( DiffusionIterationStatisticsEvent() );
+      if( this->GetAbortGenerateData() )
+        {
+        this->InvokeEvent( IterationEvent() );
+        this->ResetPipeline(); 
+        throw ProcessAborted(__FILE__,__LINE__);
+        }
       }
     }
+  catch( ... )
+    {
+    if ( startThreadPool )
+      {
+      m_ThreadPool->Stop();
+      }
+    throw;
+    }
+
+  if ( startThreadPool )
+    {
+    m_ThreadPool->Stop();
+    }
+
+  // Reset the state once execution is completed, so the next execution,
+  // e.g. the next piece of a streamed execution, starts again from the input
+  if ( ! this->GetManualReinitialization() )
+    {
+    this->SetStateToUninitialized();
+    }
 } 
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::EnlargeOutputRequestedRegion(DataObject *output)
+{
+  Superclass::EnlargeOutputRequestedRegion( output );
+
+  OutputImageType * out = dynamic_cast< OutputImageType * >( output );
+  if ( out )
+    {
+    typename OutputImageType::RegionType region = out->GetRequestedRegion();
+    region.PadByRadius( this->GetStreamingHaloRadius() );
+    region.Crop( out->GetLargestPossibleRegion() );
+    out->SetRequestedRegion( region );
+    }
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+unsigned long
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetStreamingHaloRadius() const
+{
+  // The stencil has a radius of 1
+  return this->GetNumberOfIterations()
+    * ( 1 + this->GetDiffusionTensorRadius() );
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+double
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetNumberOfBytesPerPixel() const
+{
+  // Input, output, update buffer, semi-implicit buffer and diffusion tensor
+  // components
+  return sizeof( typename InputImageType::PixelType )
+    + ( m_UseSemiImplicitScheme ? 3 : 2 ) * sizeof( PixelType )
+    + NumberOfDiffusionTensorComponents * sizeof( TensorValueType );
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+unsigned int
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetNumberOfStreamDivisions()
+{
+  if ( m_MemoryBudget <= 0.0 )
+    {
+    return 1;
+    }
+
+  const typename OutputImageType::RegionType & largestRegion =
+    this->GetOutput()->GetLargestPossibleRegion();
+
+  // The pieces are slabs along the last axis
+  const unsigned int splitAxis = ImageDimension - 1;
+
+  double bytesPerSlice = this->GetNumberOfBytesPerPixel();
+  for ( unsigned int i = 0; i < ImageDimension; i++ )
+    {
+    if ( i != splitAxis )
+      {
+      bytesPerSlice *= largestRegion.GetSize()[i];
+      }
+    }
+
+  const double slicesInBudget =
+    vcl_floor( m_MemoryBudget * 1024.0 * 1024.0 / bytesPerSlice );
+  const double slicesPerPiece =
+    slicesInBudget - 2.0 * this->GetStreamingHaloRadius();
+
+  const double numberOfSlices = largestRegion.GetSize()[splitAxis];
+  if ( slicesInBudget >= numberOfSlices )
+    {
+    return 1;
+    }
+  if ( slicesPerPiece < 1.0 )
+    {
+    itkExceptionMacro( << "A memory budget of " << m_MemoryBudget
+                       << " MB cannot hold one slice and a halo of "
+                       << this->GetStreamingHaloRadius() << " slices" );
+    }
+
+  return static_cast< unsigned int >(
+    vcl_ceil( numberOfSlices / slicesPerPiece ) );
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+typename AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::OutputImageType *
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetOutputBufferImage()
+{
+  OutputImageType * output = this->GetOutput();
+
+  if ( m_OutputBufferImage->GetPixelContainer() != output->GetPixelContainer()
+       || m_OutputBufferImage->GetBufferedRegion()
+          != output->GetBufferedRegion() )
+    {
+    m_OutputBufferImage->CopyInformation( output );
+    m_OutputBufferImage->SetRegions( output->GetBufferedRegion() );
+    m_OutputBufferImage->SetPixelContainer( output->GetPixelContainer() );
+    }
+
+  return m_OutputBufferImage;
+}
  
-template <class TInputImage, class TOutputImage>
-typename AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
-::DiffusionTensorImagePointerType
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
-::GetDiffusionTensorImage()
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+typename AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::DiffusionTensorComponentImageType *
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetDiffusionTensorComponentImage( unsigned int component )
 {
-  return m_DiffusionTensorImage;
+  if( component >= NumberOfDiffusionTensorComponents )
+    {
+    itkExceptionMacro( << "Diffusion tensor component " << component
+                       << " is out of range" );
+    }
+  return m_DiffusionTensorComponentImages[component];
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::PrintSelf(std::ostream& os, Indent indent) const
 {
   Superclass::PrintSelf(os, indent);
 
   os << indent << "TimeStep: " << m_TimeStep  << std::endl;
+  os << indent << "UseFusedUpdate: " << m_UseFusedUpdate << std::endl;
+  os << indent << "UseSemiImplicitScheme: " << m_UseSemiImplicitScheme
+     << std::endl;
+  os << indent << "MemoryBudget: " << m_MemoryBudget << std::endl;
+  os << indent << "TemporalBlockSize: " << m_TemporalBlockSize << std::endl;
+  os << indent << "TemporalTileSize: " << m_TemporalTileSize << std::endl;
+  os << indent << "NumberOfChunksPerThread: " << m_NumberOfChunksPerThread
+     << std::endl;
+  os << indent << "ThreadPool: " << m_ThreadPool.GetPointer() << std::endl;
+  os << indent << "UseFirstTouchAllocation: " << m_UseFirstTouchAllocation
+     << std::endl;
+  os << indent << "PinThreads: " << m_PinThreads << std::endl;
+  os << indent << "Verbose: " << m_Verbose << std::endl;
+  os << indent << "DiffusionTensorUpdateInterval: "
+     << m_DiffusionTensorUpdateInterval << std::endl;
+  os << indent << "DiffusionTensorUpdateThreshold: "
+     << m_DiffusionTensorUpdateThreshold << std::endl;
 }
 
 }// end namespace itk
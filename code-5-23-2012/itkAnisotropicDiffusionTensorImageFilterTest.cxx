@@ -0,0 +1,548 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkAnisotropicDiffusionTensorImageFilterTest.cxx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+
+// Checks that the options of the diffusion filters which only change how
+// the result is computed give the same result as the reference run. The
+// edge enhancement filter is run with and without the option and the two
+// outputs are compared pixel by pixel. The Mode argument selects the
+// option:
+//
+//   FusedUpdate                    UseFusedUpdate must be bit identical
+//                                  to the two passes
+//   DiffusionTensorUpdateInterval  an interval of 1 must be bit identical
+//                                  to the default, and the statistics must
+//                                  show the tensor rebuilt only at the
+//                                  interval or once the change threshold
+//                                  is reached
+//   TemporalBlock                  TemporalBlockSize k must match the
+//                                  unblocked run with an interval of k,
+//                                  up to a few units in the last place
+//   Streaming                      the output streamed in slabs must
+//                                  match the whole image within 1% of the
+//                                  intensity range, and a memory budget
+//                                  too small for the halo must throw
+//   SemiImplicit                   on an image that only varies along x the
+//                                  diffusion tensor is diagonal and the
+//                                  semi-implicit solves must keep the
+//                                  range and the mean of the input and
+//                                  leave the image constant along y and z,
+//                                  far above the explicit time step limit
+//
+// The SemiImplicit mode builds its own input image.
+
+#include "itkAnisotropicEdgeEnhancementDiffusionImageFilter.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkImageRegionIteratorWithIndex.h"
+#include "itkMinimumMaximumImageCalculator.h"
+#include "itkStreamingImageFilter.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace
+{
+const unsigned int Dimension = 3;
+
+typedef short       InputPixelType;
+#ifdef USE_FLOAT_PRECISION
+typedef float       OutputPixelType;
+typedef float       TensorValueType;
+#else
+typedef double      OutputPixelType;
+typedef double      TensorValueType;
+#endif
+
+typedef itk::Image< InputPixelType, Dimension>           InputImageType;
+typedef itk::Image< OutputPixelType, Dimension>          OutputImageType;
+
+typedef itk::AnisotropicEdgeEnhancementDiffusionImageFilter< InputImageType,
+                                            OutputImageType,
+                                            TensorValueType>  FilterType;
+
+// The filter with the parameters of the reference run
+FilterType::Pointer CreateFilter( const InputImageType * input )
+{
+  FilterType::Pointer filter = FilterType::New();
+  filter->SetInput( input );
+  filter->SetSigma( 1.0 );
+  filter->SetContrastParameterLambdaE( 30.0 );
+  filter->SetTimeStep( 0.05 );
+  filter->SetNumberOfIterations( 6 );
+  return filter;
+}
+
+// Run the filter and keep its output
+OutputImageType::Pointer Run( FilterType * filter )
+{
+  filter->Update();
+  OutputImageType::Pointer output = filter->GetOutput();
+  output->DisconnectPipeline();
+  return output;
+}
+
+// Largest absolute difference between two images of the same region
+double MaximumDifference( const OutputImageType * image,
+                          const OutputImageType * reference )
+{
+  itk::ImageRegionConstIterator<OutputImageType> it( image,
+    reference->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<OutputImageType> referenceIt( reference,
+    reference->GetLargestPossibleRegion() );
+  double maximum = 0.0;
+  for ( ; !referenceIt.IsAtEnd(); ++it, ++referenceIt )
+    {
+    const double difference = vnl_math_abs(
+      static_cast<double>( it.Get() ) - static_cast<double>( referenceIt.Get() ) );
+    if ( difference > maximum )
+      {
+      maximum = difference;
+      }
+    }
+  return maximum;
+}
+
+// Difference between the largest and the smallest pixel
+double IntensityRange( const OutputImageType * image )
+{
+  typedef itk::MinimumMaximumImageCalculator<OutputImageType> CalculatorType;
+  CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetImage( image );
+  calculator->Compute();
+  return static_cast<double>( calculator->GetMaximum() )
+    - static_cast<double>( calculator->GetMinimum() );
+}
+
+// Difference allowed between two runs that only differ by rounding: a few
+// hundred units in the last place of the largest pixel
+double RoundingTolerance( const OutputImageType * reference )
+{
+  typedef itk::MinimumMaximumImageCalculator<OutputImageType> CalculatorType;
+  CalculatorType::Pointer calculator = CalculatorType::New();
+  calculator->SetImage( reference );
+  calculator->Compute();
+  const double largest = vnl_math_max(
+    vnl_math_abs( static_cast<double>( calculator->GetMinimum() ) ),
+    vnl_math_abs( static_cast<double>( calculator->GetMaximum() ) ) );
+  return 256.0 * itk::NumericTraits<OutputPixelType>::epsilon()
+    * vnl_math_max( largest, 1.0 );
+}
+
+int TestFusedUpdate( const InputImageType * input )
+{
+  FilterType::Pointer twoPass = CreateFilter( input );
+  OutputImageType::Pointer reference = Run( twoPass );
+
+  FilterType::Pointer fused = CreateFilter( input );
+  fused->UseFusedUpdateOn();
+  OutputImageType::Pointer output = Run( fused );
+
+  // Both round the update to the pixel type and add it the same way
+  const double difference = MaximumDifference( output, reference );
+  std::cout << "Fused update maximum difference: " << difference << std::endl;
+  if ( difference != 0.0 )
+    {
+    std::cerr << "The fused update differs from the two passes" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+// Check the iterations the diffusion tensor image was rebuilt at against
+// the interval and the threshold
+bool CheckDiffusionTensorUpdates( const FilterType * filter )
+{
+  const FilterType::IterationStatisticsContainer & statistics =
+    filter->GetIterationStatistics();
+  if ( statistics.size() != filter->GetNumberOfIterations() )
+    {
+    std::cerr << "Expected the statistics of "
+              << filter->GetNumberOfIterations() << " iterations, got "
+              << statistics.size() << std::endl;
+    return false;
+    }
+
+  unsigned int iterationsSinceUpdate = 0;
+  double changeSinceUpdate = 0.0;
+  for ( unsigned int i = 0; i < statistics.size(); i++ )
+    {
+    bool expected = true;
+    if ( i > 0 )
+      {
+      iterationsSinceUpdate++;
+      changeSinceUpdate += statistics[i-1].RMSChange;
+      expected =
+        iterationsSinceUpdate >= filter->GetDiffusionTensorUpdateInterval()
+        || ( filter->GetDiffusionTensorUpdateThreshold() > 0.0
+             && changeSinceUpdate
+                >= filter->GetDiffusionTensorUpdateThreshold() );
+      }
+    if ( statistics[i].DiffusionTensorUpdated != expected )
+      {
+      std::cerr << "The diffusion tensor image was "
+                << ( expected ? "not " : "" ) << "rebuilt before iteration "
+                << statistics[i].Iteration << std::endl;
+      return false;
+      }
+    if ( expected )
+      {
+      iterationsSinceUpdate = 0;
+      changeSinceUpdate = 0.0;
+      }
+    }
+  return true;
+}
+
+// Number of times the diffusion tensor image was rebuilt
+unsigned int NumberOfDiffusionTensorUpdates( const FilterType * filter )
+{
+  const FilterType::IterationStatisticsContainer & statistics =
+    filter->GetIterationStatistics();
+  unsigned int numberOfUpdates = 0;
+  for ( unsigned int i = 0; i < statistics.size(); i++ )
+    {
+    if ( statistics[i].DiffusionTensorUpdated )
+      {
+      numberOfUpdates++;
+      }
+    }
+  return numberOfUpdates;
+}
+
+int TestDiffusionTensorUpdateInterval( const InputImageType * input )
+{
+  FilterType::Pointer defaultFilter = CreateFilter( input );
+  OutputImageType::Pointer reference = Run( defaultFilter );
+  if ( !CheckDiffusionTensorUpdates( defaultFilter ) ||
+       NumberOfDiffusionTensorUpdates( defaultFilter )
+         != defaultFilter->GetNumberOfIterations() )
+    {
+    std::cerr << "The default run must rebuild the diffusion tensor image at "
+              << "every iteration" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // An interval of 1 is the default
+  FilterType::Pointer everyIteration = CreateFilter( input );
+  everyIteration->SetDiffusionTensorUpdateInterval( 1 );
+  OutputImageType::Pointer output = Run( everyIteration );
+  double difference = MaximumDifference( output, reference );
+  std::cout << "Interval 1 maximum difference: " << difference << std::endl;
+  if ( difference != 0.0 )
+    {
+    std::cerr << "An interval of 1 differs from the default run" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Rebuilt before iterations 1 and 4 of 6
+  FilterType::Pointer interval = CreateFilter( input );
+  interval->SetDiffusionTensorUpdateInterval( 3 );
+  output = Run( interval );
+  if ( !CheckDiffusionTensorUpdates( interval ) ||
+       NumberOfDiffusionTensorUpdates( interval ) != 2 )
+    {
+    std::cerr << "An interval of 3 must rebuild the diffusion tensor image "
+              << "twice in 6 iterations" << std::endl;
+    return EXIT_FAILURE;
+    }
+  difference = MaximumDifference( output, reference );
+  std::cout << "Interval 3 maximum difference: " << difference << std::endl;
+  if ( difference == 0.0 )
+    {
+    std::cerr << "An interval of 3 gives the same output as the default"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // With an interval longer than the run only the threshold can trigger a
+  // rebuild. The first iteration is the same as in the default run, so
+  // half its change is sure to be reached after it.
+  FilterType::Pointer adaptive = CreateFilter( input );
+  adaptive->SetDiffusionTensorUpdateInterval( 100 );
+  adaptive->SetDiffusionTensorUpdateThreshold(
+    0.5 * defaultFilter->GetIterationStatistics()[0].RMSChange );
+  Run( adaptive );
+  if ( !CheckDiffusionTensorUpdates( adaptive ) ||
+       NumberOfDiffusionTensorUpdates( adaptive ) < 2 )
+    {
+    std::cerr << "The change threshold did not trigger a rebuild of the "
+              << "diffusion tensor image" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
+
+int TestTemporalBlock( const InputImageType * input )
+{
+  // The diffusion tensor image is frozen during a block, so blocks of 3 are
+  // the unblocked run with an interval of 3. 7 iterations also cover the
+  // single iteration left after the last block.
+  const unsigned int blockSize = 3;
+
+  FilterType::Pointer unblocked = CreateFilter( input );
+  unblocked->SetNumberOfIterations( 7 );
+  unblocked->SetDiffusionTensorUpdateInterval( blockSize );
+  OutputImageType::Pointer reference = Run( unblocked );
+
+  // Tiles smaller than the image, the last ones partial
+  FilterType::Pointer blocked = CreateFilter( input );
+  blocked->SetNumberOfIterations( 7 );
+  blocked->SetTemporalBlockSize( blockSize );
+  blocked->SetTemporalTileSize( 8 );
+  OutputImageType::Pointer output = Run( blocked );
+
+  const double tolerance = RoundingTolerance( reference );
+  const double difference = MaximumDifference( output, reference );
+  std::cout << "Temporal block maximum difference: " << difference
+            << " tolerance: " << tolerance << std::endl;
+  if ( difference > tolerance )
+    {
+    std::cerr << "The temporal blocks differ from the unblocked run"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+int TestStreaming( const InputImageType * input )
+{
+  // Few iterations keep the halo of 8 slices per iteration smaller than
+  // the 50 slices of the test image
+  FilterType::Pointer whole = CreateFilter( input );
+  whole->SetNumberOfIterations( 2 );
+  OutputImageType::Pointer reference = Run( whole );
+
+  FilterType::Pointer streamed = CreateFilter( input );
+  streamed->SetNumberOfIterations( 2 );
+
+  typedef itk::StreamingImageFilter<OutputImageType, OutputImageType>
+    StreamerType;
+  StreamerType::Pointer streamer = StreamerType::New();
+  streamer->SetInput( streamed->GetOutput() );
+  streamer->SetNumberOfStreamDivisions( 5 );
+  streamer->Update();
+
+  // The structure tensor is cut at three standard deviations at the edges
+  // of the pieces
+  const double tolerance = 0.01 * IntensityRange( reference );
+  const double difference =
+    MaximumDifference( streamer->GetOutput(), reference );
+  std::cout << "Streamed maximum difference: " << difference
+            << " tolerance: " << tolerance << std::endl;
+  if ( difference > tolerance )
+    {
+    std::cerr << "The streamed output differs from the whole image"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // 10 kB cannot hold a slice of 50 x 50 pixels, let alone the halo
+  FilterType::Pointer budget = CreateFilter( input );
+  budget->SetNumberOfIterations( 2 );
+  budget->SetMemoryBudget( 0.01 );
+  budget->UpdateOutputInformation();
+  bool caught = false;
+  try
+    {
+    budget->GetNumberOfStreamDivisions();
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cout << "Expected exception caught: " << err.GetDescription()
+              << std::endl;
+    caught = true;
+    }
+  if ( !caught )
+    {
+    std::cerr << "A memory budget smaller than the halo did not throw"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+
+// A ramp along x with a step in the middle, constant along y and z
+InputImageType::Pointer CreateRampImage()
+{
+  InputImageType::SizeType size;
+  size[0] = 32;
+  size[1] = 12;
+  size[2] = 12;
+
+  InputImageType::Pointer image = InputImageType::New();
+  image->SetRegions( size );
+  image->Allocate();
+
+  itk::ImageRegionIteratorWithIndex<InputImageType> it( image,
+    image->GetLargestPossibleRegion() );
+  for ( it.GoToBegin(); !it.IsAtEnd(); ++it )
+    {
+    const long x = it.GetIndex()[0];
+    it.Set( static_cast<InputPixelType>( 4 * x + ( x >= 16 ? 100 : 0 ) ) );
+    }
+  return image;
+}
+
+int TestSemiImplicit()
+{
+  InputImageType::Pointer input = CreateRampImage();
+
+  // 2.0 is 32 times the explicit limit in 3D
+  FilterType::Pointer filter = CreateFilter( input );
+  filter->SetUseSemiImplicitScheme( true );
+  filter->SetTimeStep( 2.0 );
+  filter->SetNumberOfIterations( 5 );
+  OutputImageType::Pointer output = Run( filter );
+
+  const double tolerance = RoundingTolerance( output );
+
+  double inputMinimum = itk::NumericTraits<double>::max();
+  double inputMaximum = -itk::NumericTraits<double>::max();
+  double inputSum = 0.0;
+  itk::ImageRegionConstIterator<InputImageType> inputIt( input,
+    input->GetLargestPossibleRegion() );
+  for ( ; !inputIt.IsAtEnd(); ++inputIt )
+    {
+    const double value = inputIt.Get();
+    inputMinimum = vnl_math_min( inputMinimum, value );
+    inputMaximum = vnl_math_max( inputMaximum, value );
+    inputSum += value;
+    }
+
+  // The diffusion tensor has no mixed terms, so each solve only averages
+  // and the symmetric solve along x keeps the sum of the pixels
+  double outputSum = 0.0;
+  double outOfRange = 0.0;
+  double acrossDifference = 0.0;
+  itk::ImageRegionConstIteratorWithIndex<OutputImageType> it( output,
+    output->GetLargestPossibleRegion() );
+  for ( ; !it.IsAtEnd(); ++it )
+    {
+    const double value = it.Get();
+    outputSum += value;
+    outOfRange = vnl_math_max( outOfRange, inputMinimum - value );
+    outOfRange = vnl_math_max( outOfRange, value - inputMaximum );
+
+    OutputImageType::IndexType rowStart = it.GetIndex();
+    rowStart[1] = 0;
+    rowStart[2] = 0;
+    acrossDifference = vnl_math_max( acrossDifference,
+      vnl_math_abs( value - output->GetPixel( rowStart ) ) );
+    }
+
+  const double numberOfPixels = static_cast<double>(
+    input->GetLargestPossibleRegion().GetNumberOfPixels() );
+  const double meanDifference =
+    vnl_math_abs( outputSum - inputSum ) / numberOfPixels;
+
+  std::cout << "Semi-implicit out of range: " << outOfRange
+            << " mean difference: " << meanDifference
+            << " difference along y and z: " << acrossDifference
+            << " tolerance: " << tolerance << std::endl;
+  if ( outOfRange > tolerance )
+    {
+    std::cerr << "The semi-implicit output leaves the range of the input"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  if ( meanDifference > tolerance )
+    {
+    std::cerr << "The semi-implicit output changes the mean of the input"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+  if ( acrossDifference > tolerance )
+    {
+    std::cerr << "The semi-implicit output varies along y or z"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // The image has changed, so the solves did run
+  if ( IntensityRange( output ) > inputMaximum - inputMinimum - 1.0 )
+    {
+    std::cerr << "The semi-implicit output was not smoothed" << std::endl;
+    return EXIT_FAILURE;
+    }
+  return EXIT_SUCCESS;
+}
+}
+
+int main(int argc, char* argv [] )
+{
+  if ( argc < 3 )
+    {
+    std::cerr << "Missing Parameters: "
+              << argv[0]
+              << " Input_Image Mode"
+              << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  typedef itk::ImageFileReader< InputImageType >  ImageReaderType;
+
+  ImageReaderType::Pointer   reader = ImageReaderType::New();
+  reader->SetFileName ( argv[1] );
+
+  std::cout << "Reading input image : " << argv[1] << std::endl;
+  try
+    {
+    reader->Update();
+    }
+  catch ( itk::ExceptionObject &err )
+    {
+    std::cerr << "Exception thrown: " << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  const std::string mode = argv[2];
+  try
+    {
+    if ( mode == "FusedUpdate" )
+      {
+      return TestFusedUpdate( reader->GetOutput() );
+      }
+    if ( mode == "DiffusionTensorUpdateInterval" )
+      {
+      return TestDiffusionTensorUpdateInterval( reader->GetOutput() );
+      }
+    if ( mode == "TemporalBlock" )
+      {
+      return TestTemporalBlock( reader->GetOutput() );
+      }
+    if ( mode == "Streaming" )
+      {
+      return TestStreaming( reader->GetOutput() );
+      }
+    if ( mode == "SemiImplicit" )
+      {
+      return TestSemiImplicit();
+      }
+    }
+  catch( itk::ExceptionObject & err )
+    {
+    std::cerr << "Exception caught: " << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::cerr << "Unknown mode " << mode << std::endl;
+  return EXIT_FAILURE;
+}
@@ -29,8 +29,8 @@ limitations under the License.
 #include "itkDiffusionTensor3D.h"
 #include "itkHessianRecursiveGaussianImageFilter.h"
 #include "itkStructureTensorRecursiveGaussianImageFilter.h"
-#include "itkSymmetricEigenAnalysisImageFilter.h"
-#include "itkSymmetricEigenVectorAnalysisImageFilter.h"
+#include "itkSymmetricEigenSystemAnalysisImageFilter.h"
+#include "itkGradientMagnitudeRecursiveGaussianImageFilter.h"
 
 namespace itk {
 /** \class AnisotropicEdgeEnhancementDiffusionImageFilter
@@ -45,16 +45,18 @@ namespace itk {
  */
 
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage,
+          class TTensorValueType = double>
 class ITK_EXPORT AnisotropicEdgeEnhancementDiffusionImageFilter  
-  : public AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage>
+  : public AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage,
+                                                 TTensorValueType>
 {
 public:
   /** Standard class typedefs */
   typedef AnisotropicEdgeEnhancementDiffusionImageFilter Self;
 
-  typedef AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage> 
-                                                           Superclass;
+  typedef AnisotropicDiffusionTensorImageFilter<TInputImage, TOutputImage,
+                                                TTensorValueType> Superclass;
 
   typedef SmartPointer<Self>                               Pointer;
   typedef SmartPointer<const Self>                         ConstPointer;
@@ -75,27 +77,39 @@ public:
   typedef typename Superclass::DiffusionTensorImageType 
                                                 DiffusionTensorImageType;
 
-  // Structure tensor type 
-  typedef StructureTensorRecursiveGaussianImageFilter < InputImageType >
-                                                StructureTensorFilterType;
-  
+  /** Type of the diffusion tensor components */
+  typedef typename Superclass::TensorValueType  TensorValueType;
+
+  typedef typename Superclass::DiffusionTensorComponentImageType
+                                          DiffusionTensorComponentImageType;
+
   /** Dimensionality of input and output data is assumed to be the same.
    * It is inherited from the superclass. */
   itkStaticConstMacro(ImageDimension, unsigned int,Superclass::ImageDimension);
+  itkStaticConstMacro(NumberOfDiffusionTensorComponents, unsigned int,
+                      Superclass::NumberOfDiffusionTensorComponents);
 
-  typedef itk::Matrix<double, ImageDimension, ImageDimension> MatrixType;
+  typedef itk::Matrix<TensorValueType, ImageDimension, ImageDimension>
+                                                         MatrixType;
 
   // Define image of matrix pixel type 
   typedef itk::Image< MatrixType, ImageDimension>  OutputMatrixImageType;
 
   // Define the symmetric tensor pixel type
-  typedef itk::SymmetricSecondRankTensor< double, ImageDimension> 
+  typedef itk::SymmetricSecondRankTensor< TensorValueType, ImageDimension> 
                                                          TensorPixelType;
   typedef itk::Image< TensorPixelType, ImageDimension>  
                                                          TensorImageType;
 
+  // Structure tensor type. It is computed from the output, which changes
+  // at each iteration.
+  typedef StructureTensorRecursiveGaussianImageFilter < OutputImageType,
+                                                        TensorImageType >
+                                                StructureTensorFilterType;
+
    // Define the type for storing the eigen-value
-  typedef itk::FixedArray< double, ImageDimension >      EigenValueArrayType;
+  typedef itk::FixedArray< TensorValueType, ImageDimension >
+                                                         EigenValueArrayType;
   
   // Declare the types of the output images
   typedef itk::Image< EigenValueArrayType, ImageDimension >  
@@ -108,6 +122,25 @@ public:
   typedef typename Superclass::DiffusionTensorNeighborhoodType
                                                DiffusionTensorNeighborhoodType;
 
+  /** Types of the eigen system of the structure tensor. The eigen vectors
+   * are the rows of the eigen vector matrix. */
+  typedef MatrixType                               EigenVectorMatrixType;
+  typedef OutputMatrixImageType                    EigenVectorImageType;
+  typedef EigenAnalysisOutputImageType             EigenValueImageType;
+  typedef SymmetricEigenSystemAnalysisImageFilter<
+    typename StructureTensorFilterType::OutputImageType,
+    EigenValueImageType, EigenVectorImageType >    EigenSystemAnalysisFilterType;
+
+  /** Gradient magnitude types, used to set Lambda1. The gradient magnitude
+   * is held in the output pixel type and is computed either from the input,
+   * in its own pixel type, or from the output. */
+  typedef OutputImageType                       GradientMagnitudeImageType;
+  typedef GradientMagnitudeRecursiveGaussianImageFilter< InputImageType,
+                     GradientMagnitudeImageType >  GradientMagnitudeFilterType;
+  typedef GradientMagnitudeRecursiveGaussianImageFilter< OutputImageType,
+                     GradientMagnitudeImageType >
+                                          OutputGradientMagnitudeFilterType;
+
   /** Set the contrast parameter */
   void SetContrastParameterLambdaE( double value ); 
 
@@ -117,6 +150,18 @@ public:
   /** Set the sigma value for structure tensor computation */
   void SetSigma( double sigma );
 
+  /** Compute the gradient magnitude that sets Lambda1 from the evolving
+   * output, as in the published formulation, instead of from the input.
+   * The gradient magnitude of the input does not change while iterating,
+   * so it is only computed once per GenerateData(). Default is off. */
+  itkSetMacro( ComputeGradientMagnitudeFromOutput, bool );
+  itkGetConstMacro( ComputeGradientMagnitudeFromOutput, bool );
+  itkBooleanMacro( ComputeGradientMagnitudeFromOutput );
+
+  /** Get the gradient magnitude image used in the last iteration */
+  const GradientMagnitudeImageType * GetGradientMagnitudeImage() const
+    { return m_GradientMagnitudeImage; }
+
 
 protected:
   AnisotropicEdgeEnhancementDiffusionImageFilter();
@@ -125,6 +170,22 @@ protected:
 
   /** Update diffusion tensor image */
   void virtual UpdateDiffusionTensorImage();
+
+  /** Extent of the structure tensor kernels */
+  virtual unsigned long GetDiffusionTensorRadius() const;
+
+  /** Add the images of the structure tensor pipeline */
+  virtual double GetNumberOfBytesPerPixel() const;
+
+  typedef typename Superclass::ThreadDiffusionTensorImageRegionType
+                                        ThreadDiffusionTensorImageRegionType;
+
+  /** Build the diffusion tensors of a region from the eigen system of the
+   * structure tensor */
+  virtual
+  void ThreadedGenerateDiffusionTensorImage(
+               const ThreadDiffusionTensorImageRegionType &diffusionRegionToProcess,
+               int threadId);
  
 private:
   //purposely not implemented
@@ -134,6 +195,19 @@ private:
   double    m_ContrastParameterLambdaE;
   double    m_ThresholdParameterC;
   double    m_Sigma;
+  bool      m_ComputeGradientMagnitudeFromOutput;
+
+  /** Structure tensor mini-pipeline. It is created once and its buffers
+   * are reused by every iteration. */
+  typename StructureTensorFilterType::Pointer      m_StructureTensorFilter;
+  typename EigenSystemAnalysisFilterType::Pointer  m_EigenSystemAnalysisFilter;
+  typename GradientMagnitudeFilterType::Pointer    m_GradientMagnitudeFilter;
+  typename OutputGradientMagnitudeFilterType::Pointer
+                                          m_OutputGradientMagnitudeFilter;
+
+  typename EigenValueImageType::Pointer         m_EigenValueImage;
+  typename EigenVectorImageType::Pointer        m_EigenVectorImage;
+  typename GradientMagnitudeImageType::Pointer  m_GradientMagnitudeImage;
 };
   
 
@@ -43,24 +43,37 @@ namespace itk {
 /**
  * Constructor
  */
-template <class TInputImage, class TOutputImage>
-AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::AnisotropicEdgeEnhancementDiffusionImageFilter()
 {
   m_ThresholdParameterC = 3.31488;
   m_ContrastParameterLambdaE = 30.0;
   m_Sigma = 1.0;
+  m_ComputeGradientMagnitudeFromOutput = false;
+
+  m_StructureTensorFilter = StructureTensorFilterType::New();
+
+  m_EigenSystemAnalysisFilter = EigenSystemAnalysisFilterType::New();
+  m_EigenSystemAnalysisFilter->SetDimension( 3 );
+  m_EigenSystemAnalysisFilter->OrderEigenValuesBy(
+    EigenSystemAnalysisFilterType::OrderByValue );
+  m_EigenSystemAnalysisFilter->UseClosedFormSolverOn();
+  m_EigenSystemAnalysisFilter->SetInput( m_StructureTensorFilter->GetOutput() );
+
+  m_GradientMagnitudeFilter = GradientMagnitudeFilterType::New();
+  m_GradientMagnitudeFilter->SetSigma( m_Sigma );
+  m_OutputGradientMagnitudeFilter = OutputGradientMagnitudeFilterType::New();
+  m_OutputGradientMagnitudeFilter->SetSigma( m_Sigma );
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::UpdateDiffusionTensorImage()
 {
   itkDebugMacro( << "UpdateDiffusionTensorImage() called" );
 
-  std::cerr << "UpdateDiffusionTensorImage()" << std::endl;
-
   /* IN THIS METHOD, the following items will be implemented
    - Compute the local structure tensor
    - Compute its eigen vectors
@@ -68,118 +81,99 @@ AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
   */
 
   //Step 1: Compute the structure tensor and identify the eigen vectors
-  //Step 1.1: Compute the structure tensor
-  // Instantiate the structure tensor filter
-  typename StructureTensorFilterType::Pointer
-          StructureTensorFilter  = StructureTensorFilterType::New();
-
-  StructureTensorFilter->SetInput( this->GetOutput() );
-  StructureTensorFilter->SetSigma( m_Sigma );
-  StructureTensorFilter->Update();
-
-  // Step 1.2: Identify the eigen vectors of the structure tensor
-  typedef  Matrix< double, 3, 3>
-    EigenVectorMatrixType;
-  typedef  Image< EigenVectorMatrixType, 3>
-    EigenVectorImageType;
-  typedef  typename itk::Image< EigenValueArrayType, 3>
-    EigenValueImageType;
-
-  typedef  typename StructureTensorFilterType::OutputImageType
-    SymmetricSecondRankTensorImageType;
-  typedef  typename itk::
-    SymmetricEigenVectorAnalysisImageFilter<
-    SymmetricSecondRankTensorImageType, EigenValueImageType,
-    EigenVectorImageType>
-    EigenVectorAnalysisFilterType;
-
-  typename EigenVectorAnalysisFilterType::Pointer eigenVectorAnalysisFilter
-    = EigenVectorAnalysisFilterType::New();
-  eigenVectorAnalysisFilter->SetDimension( 3 );
-  eigenVectorAnalysisFilter->OrderEigenValuesBy(
-    EigenVectorAnalysisFilterType::FunctorType::OrderByValue );
-
-  eigenVectorAnalysisFilter->SetInput( StructureTensorFilter->GetOutput() );
-  eigenVectorAnalysisFilter->Modified();
-  eigenVectorAnalysisFilter->Update();
-
-  //Step 1.3: Compute the eigen values
-  typedef itk::
-    SymmetricEigenAnalysisImageFilter<SymmetricSecondRankTensorImageType,
-    EigenValueImageType>
-    EigenAnalysisFilterType;
-
-  typename EigenAnalysisFilterType::Pointer eigenAnalysisFilter =
-    EigenAnalysisFilterType::New();
-  eigenAnalysisFilter->SetDimension( 3 );
-  eigenAnalysisFilter->OrderEigenValuesBy(
-    EigenAnalysisFilterType::FunctorType::OrderByValue );
-
-  eigenAnalysisFilter->SetInput( StructureTensorFilter->GetOutput() );
-  eigenAnalysisFilter->Update();
-
-  /* Compute the gradient magnitude. This is required to set Lambda1 */
-
-  typedef itk::GradientMagnitudeRecursiveGaussianImageFilter<InputImageType>
-    GradientMagnitudeFilterType;
-
-  typename GradientMagnitudeFilterType::Pointer gradientMagnitudeFilter =
-    GradientMagnitudeFilterType::New();
-  gradientMagnitudeFilter->SetInput( this->GetInput() );
-  gradientMagnitudeFilter->SetSigma( m_Sigma );
-  gradientMagnitudeFilter->Update();
+  //Step 1.1: Compute the structure tensor. ApplyUpdate() changes the
+  // output in place without touching its modified time, so the filter has
+  // to be marked as modified to run again.
+  // The internal filters run with the threads of this filter, or of the
+  // thread pool it shares, instead of the global default
+  const int numberOfThreads = this->GetNumberOfThreaderThreads();
+  m_StructureTensorFilter->SetNumberOfThreads( numberOfThreads );
+  m_EigenSystemAnalysisFilter->SetNumberOfThreads( numberOfThreads );
+  m_GradientMagnitudeFilter->SetNumberOfThreads( numberOfThreads );
+  m_OutputGradientMagnitudeFilter->SetNumberOfThreads( numberOfThreads );
+
+  m_StructureTensorFilter->SetInput( this->GetOutputBufferImage() );
+  m_StructureTensorFilter->SetSigma( m_Sigma );
+  m_StructureTensorFilter->Modified();
+
+  this->BeginPhase( Superclass::StructureTensorPhase );
+  m_StructureTensorFilter->Update();
+  this->EndPhase( Superclass::StructureTensorPhase );
+
+  // Step 1.2: Solve the eigen system of the structure tensor. The eigen
+  // values and the eigen vectors are computed together in a single pass,
+  // with the closed-form solver since the tensors are 3x3.
+  this->BeginPhase( Superclass::EigenAnalysisPhase );
+  m_EigenSystemAnalysisFilter->Update();
+  this->EndPhase( Superclass::EigenAnalysisPhase );
+
+  m_EigenValueImage = m_EigenSystemAnalysisFilter->GetEigenValueImage();
+  m_EigenVectorImage = m_EigenSystemAnalysisFilter->GetEigenVectorImage();
+
+  /* Compute the gradient magnitude. This is required to set Lambda1.
+     The input does not change while iterating, so the filter only runs
+     again when the input or sigma changed, i.e. once per GenerateData(). */
+  this->BeginPhase( Superclass::StructureTensorPhase );
+  if( m_ComputeGradientMagnitudeFromOutput )
+    {
+    m_OutputGradientMagnitudeFilter->SetInput( this->GetOutputBufferImage() );
+    m_OutputGradientMagnitudeFilter->Modified();
+    m_OutputGradientMagnitudeFilter->Update();
+    m_GradientMagnitudeImage = m_OutputGradientMagnitudeFilter->GetOutput();
+    }
+  else
+    {
+    m_GradientMagnitudeFilter->SetInput( this->GetInputBufferImage() );
+    m_GradientMagnitudeFilter->Update();
+    m_GradientMagnitudeImage = m_GradientMagnitudeFilter->GetOutput();
+    }
+  this->EndPhase( Superclass::StructureTensorPhase );
 
   /* Step 2: Generate the diffusion tensor matrix
       D = [v1 v2 v3] [DiagonalMatrixContainingLambdas] [v1 v2 v3]^t
+     The tensors are independent of each other, so this is multithreaded.
   */
+  this->GenerateDiffusionTensorImage();
+}
 
-  //Setup the iterators
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+void
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::ThreadedGenerateDiffusionTensorImage(
+  const ThreadDiffusionTensorImageRegionType &diffusionRegionToProcess, int)
+{
+  //Setup the iterators over the region of this thread
   //
   //Iterator for the eigenvector matrix image
-  EigenVectorImageType::ConstPointer eigenVectorImage =
-    eigenVectorAnalysisFilter->GetOutput();
   itk::ImageRegionConstIterator<EigenVectorImageType>
-    eigenVectorImageIterator;
-  eigenVectorImageIterator =
-    itk::ImageRegionConstIterator<EigenVectorImageType>(
-    eigenVectorImage, eigenVectorImage->GetRequestedRegion());
-  eigenVectorImageIterator.GoToBegin();
+    eigenVectorImageIterator( m_EigenVectorImage, diffusionRegionToProcess );
 
-  //Iterator for the diffusion tensor image
-  typedef itk::ImageRegionIterator< DiffusionTensorImageType >
+  //Iterators for the diffusion tensor component images
+  typedef itk::ImageRegionIterator< DiffusionTensorComponentImageType >
     DiffusionTensorIteratorType;
-  DiffusionTensorIteratorType it( this->GetDiffusionTensorImage(),
-    this->GetDiffusionTensorImage()->GetLargestPossibleRegion() );
+  DiffusionTensorIteratorType it[NumberOfDiffusionTensorComponents];
+  for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+    {
+    it[k] = DiffusionTensorIteratorType(
+      this->GetDiffusionTensorComponentImage( k ), diffusionRegionToProcess );
+    it[k].GoToBegin();
+    }
 
   //Iterator for the eigen value image
-  typename EigenValueImageType::ConstPointer eigenImage =
-    eigenAnalysisFilter->GetOutput();
   itk::ImageRegionConstIterator<EigenValueImageType>
-    eigenValueImageIterator;
-  eigenValueImageIterator =
-    itk::ImageRegionConstIterator<EigenValueImageType>( eigenImage,
-    eigenImage->GetRequestedRegion());
+    eigenValueImageIterator( m_EigenValueImage, diffusionRegionToProcess );
 
   //Iterator for the gradient magnitude image
-  typedef typename GradientMagnitudeFilterType::OutputImageType
-    GradientMagnitudeOutputImageType;
-  typename GradientMagnitudeOutputImageType::Pointer
-    gradientMagnitudeOutputImage = gradientMagnitudeFilter->GetOutput();
-
-  itk::ImageRegionConstIterator<GradientMagnitudeOutputImageType>
-    gradientMagnitudeImageIterator;
-  gradientMagnitudeImageIterator = itk::ImageRegionConstIterator<
-    GradientMagnitudeOutputImageType>(
-    gradientMagnitudeOutputImage,
-    gradientMagnitudeOutputImage->GetRequestedRegion());
-
-  it.GoToBegin();
+  itk::ImageRegionConstIterator<GradientMagnitudeImageType>
+    gradientMagnitudeImageIterator( m_GradientMagnitudeImage,
+    diffusionRegionToProcess );
+
   eigenVectorImageIterator.GoToBegin();
   eigenValueImageIterator.GoToBegin();
   gradientMagnitudeImageIterator.GoToBegin();
 
   MatrixType  eigenValueMatrix;
-  while( !it.IsAtEnd() )
+  while( !it[0].IsAtEnd() )
     {
     // Generate the diagonal matrix with the eigen values
     eigenValueMatrix.SetIdentity();
@@ -258,85 +252,100 @@ AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
     eigenValueMatrix(1,1) = Lambda2;
     eigenValueMatrix(2,2) = Lambda3;
 
-    //Get the eigenVector matrix
+    //Get the eigenVector matrix. The eigen vectors are its rows; put them
+    //in the order of the eigen values.
+    const EigenVectorMatrixType eigenVectors = eigenVectorImageIterator.Get();
     EigenVectorMatrixType eigenVectorMatrix;
     unsigned int vectorLength = 3; // Eigenvector length
 
-    itk::VariableLengthVector<double> firstEigenVector( vectorLength );
-    itk::VariableLengthVector<double> secondEigenVector( vectorLength );
-    itk::VariableLengthVector<double> thirdEigenVector( vectorLength );
-
-    for ( unsigned int i=0; i < vectorLength; i++ ) {
-    // Get eigenvectors belonging to eigenvalue order
-      firstEigenVector[i] = eigenVectorMatrix[largestEigenValueIndex][i];
-      secondEigenVector[i] = eigenVectorMatrix[middleEigenValueIndex][i];
-      thirdEigenVector[i] = eigenVectorMatrix[smallestEigenValueIndex][i];
-     
-      // Set eigenVectorMatrix in correct order
-      eigenVectorMatrix[0][i] = firstEigenVector[i];
-      eigenVectorMatrix[1][i] = secondEigenVector[i];
-      eigenVectorMatrix[2][i] = thirdEigenVector[i];
+    for ( unsigned int i=0; i < vectorLength; i++ )
+      {
+      eigenVectorMatrix[0][i] = eigenVectors[largestEigenValueIndex][i];
+      eigenVectorMatrix[1][i] = eigenVectors[middleEigenValueIndex][i];
+      eigenVectorMatrix[2][i] = eigenVectors[smallestEigenValueIndex][i];
       }
 
     EigenVectorMatrixType  eigenVectorMatrixTranspose;
     eigenVectorMatrixTranspose = eigenVectorMatrix.GetTranspose();
 
-    // Generate the tensor matrix
+    // Generate the tensor matrix. The eigen vectors are stored as rows,
+    // so [v1 v2 v3] is the transpose of the eigen vector matrix.
     EigenVectorMatrixType  productMatrix;
-    productMatrix = eigenVectorMatrix * eigenValueMatrix
-      * eigenVectorMatrixTranspose;
-
-    //Copy the ITK::Matrix to the tensor...there should be a better way
-    //of doing this TODO
-    typename DiffusionTensorImageType::PixelType        tensor;
-
-    tensor(0,0) = productMatrix(0,0);
-    tensor(0,1) = productMatrix(0,1);
-    tensor(0,2) = productMatrix(0,2);
-
-    tensor(1,0) = productMatrix(1,0);
-    tensor(1,1) = productMatrix(1,1);
-    tensor(1,2) = productMatrix(1,2);
-
-    tensor(2,0) = productMatrix(2,0);
-    tensor(2,1) = productMatrix(2,1);
-    tensor(2,2) = productMatrix(2,2);
-    it.Set( tensor );
-
-    ++it;
+    productMatrix = eigenVectorMatrixTranspose * eigenValueMatrix
+      * eigenVectorMatrix;
+
+    //Store the independent elements of the symmetric matrix
+    it[0].Set( productMatrix(0,0) );
+    it[1].Set( productMatrix(0,1) );
+    it[2].Set( productMatrix(0,2) );
+    it[3].Set( productMatrix(1,1) );
+    it[4].Set( productMatrix(1,2) );
+    it[5].Set( productMatrix(2,2) );
+
+    for( unsigned int k = 0; k < NumberOfDiffusionTensorComponents; k++ )
+      {
+      ++it[k];
+      }
     ++eigenValueImageIterator;
     ++eigenVectorImageIterator;
     ++gradientMagnitudeImageIterator;
     }
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+unsigned long
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetDiffusionTensorRadius() const
+{
+  // The derivatives and the outer smoothing of the structure tensor, cut
+  // at three standard deviations. The gradient magnitude kernel is smaller.
+  return static_cast< unsigned long >( vcl_ceil( 3.0 * m_Sigma )
+    + vcl_ceil( 3.0 * m_StructureTensorFilter->GetSigmaOuter() ) ) + 1;
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
+double
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
+::GetNumberOfBytesPerPixel() const
+{
+  // Structure tensor, eigen values, eigen vectors and gradient magnitude
+  return Superclass::GetNumberOfBytesPerPixel()
+    + sizeof( TensorPixelType )
+    + sizeof( EigenValueArrayType )
+    + sizeof( EigenVectorMatrixType )
+    + sizeof( typename GradientMagnitudeImageType::PixelType );
+}
+
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::SetSigma( double sigma)
 {
   m_Sigma = sigma;
+  m_GradientMagnitudeFilter->SetSigma( sigma );
+  m_OutputGradientMagnitudeFilter->SetSigma( sigma );
+  this->Modified();
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::SetThresholdParameterC( double threshold)
 {
   m_ThresholdParameterC = threshold;
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::SetContrastParameterLambdaE( double contrast)
 {
   m_ContrastParameterLambdaE = contrast;
 }
 
-template <class TInputImage, class TOutputImage>
+template <class TInputImage, class TOutputImage, class TTensorValueType>
 void
-AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
+AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage, TTensorValueType>
 ::PrintSelf(std::ostream& os, Indent indent) const
 {
   Superclass::PrintSelf(os, indent);
@@ -344,6 +353,8 @@ AnisotropicEdgeEnhancementDiffusionImageFilter<TInputImage, TOutputImage>
   os << indent << "Contrast parameter LambdaE: "
     << m_ContrastParameterLambdaE  << std::endl;
   os << indent << "Sigma : " << m_Sigma << std::endl;
+  os << indent << "ComputeGradientMagnitudeFromOutput: "
+    << m_ComputeGradientMagnitudeFromOutput << std::endl;
   os << indent << "Threshold parameter C "
     << m_ThresholdParameterC << std::endl;
 }
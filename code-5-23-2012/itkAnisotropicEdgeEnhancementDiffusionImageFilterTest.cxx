@@ -20,7 +20,7 @@
 
 
 #include "itkAnisotropicEdgeEnhancementDiffusionImageFilter.h"
-#include "itkImageFileReader.h"
+#include "itkMemoryMappedMetaImageReader.h"
 #include "itkImageFileWriter.h"
 
 int main(int argc, char* argv [] )
@@ -31,21 +31,33 @@ int main(int argc, char* argv [] )
               << argv[0]
               << " Input_Image"
               << " Edge_Enhanced_Output_Image [ScaleParameter] [ContrastParameter] "
-              << " [TimeStep] [NumberOfIterations]" << std::endl; 
+              << " [TimeStep] [NumberOfIterations] [UseSemiImplicitScheme]"
+              << " [TemporalBlockSize]"
+              << std::endl; 
     return EXIT_FAILURE;
     }
  
  
   // Define the dimension of the images
   const unsigned int Dimension = 3;
-  typedef double      InputPixelType;
+
+  // The CT input is kept in its 16 bit pixel type; the filter converts it
+  // to the output pixel type
+  typedef short       InputPixelType;
+#ifdef USE_FLOAT_PRECISION
+  typedef float       OutputPixelType;
+  typedef float       TensorValueType;
+#else
   typedef double      OutputPixelType;
+  typedef double      TensorValueType;
+#endif
 
   // Declare the types of the images
   typedef itk::Image< InputPixelType, Dimension>           InputImageType;
-  typedef itk::Image< InputPixelType, Dimension>           OutputImageType;
+  typedef itk::Image< OutputPixelType, Dimension>          OutputImageType;
 
-  typedef itk::ImageFileReader< InputImageType  >      ImageReaderType;
+  // The pixels of the input are used where they are in the file
+  typedef itk::MemoryMappedMetaImageReader< InputImageType >  ImageReaderType;
 
   ImageReaderType::Pointer   reader = ImageReaderType::New();
   reader->SetFileName ( argv[1] ); 
@@ -64,7 +76,8 @@ int main(int argc, char* argv [] )
 
   // Declare the anisotropic diffusion edge enhancement filter
   typedef itk::AnisotropicEdgeEnhancementDiffusionImageFilter< InputImageType,
-                                            OutputImageType>  EdgeEnhancementFilterType;
+                                            OutputImageType,
+                                            TensorValueType>  EdgeEnhancementFilterType;
 
   // Create a edge enhancement Filter
   EdgeEnhancementFilterType::Pointer EdgeEnhancementFilter = 
@@ -105,8 +118,21 @@ int main(int argc, char* argv [] )
   EdgeEnhancementFilter->SetNumberOfIterations( numberOfIterations );
   } 
 
+  //Use the semi-implicit AOS scheme
+  if( argc > 7 ) 
+  {
+  EdgeEnhancementFilter->SetUseSemiImplicitScheme( atoi(argv[7]) != 0 );
+  } 
+
+  //Advance several iterations per tile
+  if( argc > 8 ) 
+  {
+  EdgeEnhancementFilter->SetTemporalBlockSize( atoi(argv[8]) );
+  } 
+
   std::cout << "Enhancing .........: " << argv[1] << std::endl;
 
+  EdgeEnhancementFilter->VerboseOn();
   EdgeEnhancementFilter->Print( std::cout );
 
   try
@@ -119,6 +145,16 @@ int main(int argc, char* argv [] )
     return EXIT_FAILURE;
     }
 
+  // Each iteration of the run has left its statistics
+  const EdgeEnhancementFilterType::IterationStatisticsContainer & statistics =
+    EdgeEnhancementFilter->GetIterationStatistics();
+  if( statistics.empty() ||
+      statistics.back().Iteration != EdgeEnhancementFilter->GetElapsedIterations() )
+    {
+    std::cerr << "The iteration statistics are missing" << std::endl;
+    return EXIT_FAILURE;
+    }
+
   std::cout << "Writing out the enhanced image to " <<  argv[2] << std::endl;
 
   typedef itk::ImageFileWriter< OutputImageType  >      ImageWriterType;
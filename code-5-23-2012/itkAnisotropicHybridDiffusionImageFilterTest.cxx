@@ -32,7 +32,7 @@ int main(int argc, char* argv [] )
               << " Input_Image"
               << " Edge_Enhanced_Output_Image "
               << " [Sigma] [EED contrast] [CED contrast] [Hybrid contrast] "
-              << " [Alpha] "
+              << " [Alpha] [TimeStep] [NumberOfIterations] [MemoryBudget]"
               << std::endl; 
     return EXIT_FAILURE;
     }
@@ -40,12 +40,21 @@ int main(int argc, char* argv [] )
  
   // Define the dimension of the images
   const unsigned int Dimension = 3;
-  typedef double      InputPixelType;
+
+  // The CT input is kept in its 16 bit pixel type; the filter converts it
+  // to the output pixel type
+  typedef short       InputPixelType;
+#ifdef USE_FLOAT_PRECISION
+  typedef float       OutputPixelType;
+  typedef float       TensorValueType;
+#else
   typedef double      OutputPixelType;
+  typedef double      TensorValueType;
+#endif
 
   // Declare the types of the images
   typedef itk::Image< InputPixelType, Dimension>           InputImageType;
-  typedef itk::Image< InputPixelType, Dimension>           OutputImageType;
+  typedef itk::Image< OutputPixelType, Dimension>          OutputImageType;
 
   typedef itk::ImageFileReader< InputImageType  >      ImageReaderType;
 
@@ -66,7 +75,8 @@ int main(int argc, char* argv [] )
 
   // Declare the anisotropic diffusion edge enhancement filter
   typedef itk::AnisotropicHybridDiffusionImageFilter< InputImageType,
-                                            OutputImageType>  HybridFilterType;
+                                            OutputImageType,
+                                            TensorValueType>  HybridFilterType;
 
   // Create a edge enhancement Filter
   HybridFilterType::Pointer HybridFilter = 
@@ -127,12 +137,30 @@ int main(int argc, char* argv [] )
     HybridFilter->SetNumberOfIterations( numberOfIterations );
     }
 
+  // Memory budget in megabytes. The output is written in as many pieces as
+  // needed to stay within it.
+  if( argc > 10 )
+    {
+    double memoryBudget = atof( argv[10] );
+    HybridFilter->SetMemoryBudget( memoryBudget );
+    }
+
   HybridFilter->Print( std::cout ); 
   std::cout << "Enhancing .........: " << argv[1] << std::endl;
 
+  unsigned int numberOfStreamDivisions = 1;
   try
     {
-    HybridFilter->Update();
+    HybridFilter->UpdateOutputInformation();
+    numberOfStreamDivisions = HybridFilter->GetNumberOfStreamDivisions();
+    std::cout << "Number of stream divisions: " << numberOfStreamDivisions
+              << std::endl;
+
+    // A streamed execution is driven by the writer
+    if( numberOfStreamDivisions == 1 )
+      {
+      HybridFilter->Update();
+      }
     }
   catch( itk::ExceptionObject & err )
     {
@@ -147,6 +175,7 @@ int main(int argc, char* argv [] )
 
   writer->SetFileName( argv[2] );
   writer->SetInput ( HybridFilter->GetOutput() );
+  writer->SetNumberOfStreamDivisions( numberOfStreamDivisions );
 
   try
     {
@@ -0,0 +1,139 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkAsynchronousImageFileReader_h
+#define __itkAsynchronousImageFileReader_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImageFileReader.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleMutexLock.h"
+#include "itkConditionVariable.h"
+#include "itkNumericTraits.h"
+
+#include <deque>
+#include <string>
+
+namespace itk
+{
+
+/** \class AsynchronousImageFileReader
+ * \brief Reads images on a background thread ahead of their use.
+ *
+ * Prefetch() queues file names and returns at once. A background thread
+ * reads the files in order with an ImageFileReader while the caller works
+ * on the previous image. GetNextImage() returns the images in the order
+ * they were queued and waits when the next one is not read yet. At most
+ * MaximumNumberOfReadAheadImages images are held that were read but not yet
+ * taken, which bounds the memory. The returned images are disconnected from
+ * the reader pipeline.
+ *
+ * GetNextImage() throws the error of a file that could not be read; the
+ * following files are not affected. The background thread is started by
+ * the first Prefetch() and ends with the object.
+ *
+ * \sa AsynchronousImageFileWriter
+ */
+template <class TOutputImage>
+class ITK_EXPORT AsynchronousImageFileReader : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef AsynchronousImageFileReader  Self;
+  typedef Object                       Superclass;
+  typedef SmartPointer<Self>           Pointer;
+  typedef SmartPointer<const Self>     ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(AsynchronousImageFileReader, Object);
+
+  typedef TOutputImage                          OutputImageType;
+  typedef typename OutputImageType::Pointer     OutputImagePointer;
+  typedef ImageFileReader<OutputImageType>      ReaderType;
+
+  /** Number of images that may wait to be taken. Default is 1, i.e. the
+   * next image is read while the current one is processed. */
+  itkSetClampMacro( MaximumNumberOfReadAheadImages, unsigned int,
+                    1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( MaximumNumberOfReadAheadImages, unsigned int );
+
+  /** Queue a file to be read in the background. */
+  void Prefetch( const std::string & fileName );
+
+  /** Take the next image in the order of Prefetch(), waiting until it is
+   * read. Throws when the file could not be read or when nothing was
+   * queued. */
+  OutputImagePointer GetNextImage();
+
+  /** Number of queued images not yet taken. */
+  unsigned int GetNumberOfPendingImages();
+
+protected:
+  AsynchronousImageFileReader();
+  ~AsynchronousImageFileReader();
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+private:
+  AsynchronousImageFileReader(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  /** A queued file and, once it is read, its image or its error */
+  struct Request
+    {
+    std::string        FileName;
+    OutputImagePointer Image;
+    std::string        Error;
+    bool               Done;
+    };
+
+  /** Entry point of the background thread */
+  static ITK_THREAD_RETURN_TYPE ReaderThreadCallback( void *arg );
+
+  /** Read the queued files until the object is destroyed */
+  void ReadQueuedFiles();
+
+  unsigned int                 m_MaximumNumberOfReadAheadImages;
+
+  MultiThreader::Pointer       m_Threader;
+  int                          m_ThreadID;
+  bool                         m_ThreadRunning;
+  bool                         m_Terminate;
+
+  /** Requests in the order of Prefetch(); the first m_NumberOfDoneRequests
+   * are read */
+  std::deque<Request>          m_Requests;
+  unsigned int                 m_NumberOfDoneRequests;
+  SimpleMutexLock              m_Lock;
+  ConditionVariable::Pointer   m_Condition;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkAsynchronousImageFileReader.txx"
+#endif
+
+#endif
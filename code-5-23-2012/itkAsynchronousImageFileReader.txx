@@ -0,0 +1,195 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkAsynchronousImageFileReader_txx
+#define __itkAsynchronousImageFileReader_txx
+
+#include "itkAsynchronousImageFileReader.h"
+
+namespace itk
+{
+
+template <class TOutputImage>
+AsynchronousImageFileReader<TOutputImage>
+::AsynchronousImageFileReader()
+{
+  m_MaximumNumberOfReadAheadImages = 1;
+  m_Threader = MultiThreader::New();
+  m_ThreadID = -1;
+  m_ThreadRunning = false;
+  m_Terminate = false;
+  m_NumberOfDoneRequests = 0;
+  m_Condition = ConditionVariable::New();
+}
+
+template <class TOutputImage>
+AsynchronousImageFileReader<TOutputImage>
+::~AsynchronousImageFileReader()
+{
+  if ( m_ThreadRunning )
+    {
+    m_Lock.Lock();
+    m_Terminate = true;
+    m_Condition->Broadcast();
+    m_Lock.Unlock();
+    m_Threader->TerminateThread( m_ThreadID );
+    }
+}
+
+template <class TOutputImage>
+void
+AsynchronousImageFileReader<TOutputImage>
+::Prefetch( const std::string & fileName )
+{
+  Request request;
+  request.FileName = fileName;
+  request.Done = false;
+
+  m_Lock.Lock();
+  m_Requests.push_back( request );
+  m_Condition->Broadcast();
+  m_Lock.Unlock();
+
+  if ( !m_ThreadRunning )
+    {
+    m_ThreadID = m_Threader->SpawnThread( Self::ReaderThreadCallback, this );
+    m_ThreadRunning = true;
+    }
+}
+
+template <class TOutputImage>
+typename AsynchronousImageFileReader<TOutputImage>::OutputImagePointer
+AsynchronousImageFileReader<TOutputImage>
+::GetNextImage()
+{
+  m_Lock.Lock();
+  if ( m_Requests.empty() )
+    {
+    m_Lock.Unlock();
+    itkExceptionMacro( << "No image was queued with Prefetch()." );
+    }
+  while ( m_NumberOfDoneRequests == 0 )
+    {
+    m_Condition->Wait( &m_Lock );
+    }
+  Request request = m_Requests.front();
+  m_Requests.pop_front();
+  m_NumberOfDoneRequests--;
+
+  // Room for one more image to be read ahead
+  m_Condition->Broadcast();
+  m_Lock.Unlock();
+
+  if ( !request.Error.empty() )
+    {
+    itkExceptionMacro( << "Cannot read " << request.FileName << ": "
+                       << request.Error );
+    }
+  return request.Image;
+}
+
+template <class TOutputImage>
+unsigned int
+AsynchronousImageFileReader<TOutputImage>
+::GetNumberOfPendingImages()
+{
+  m_Lock.Lock();
+  const unsigned int numberOfPendingImages = m_Requests.size();
+  m_Lock.Unlock();
+  return numberOfPendingImages;
+}
+
+template <class TOutputImage>
+ITK_THREAD_RETURN_TYPE
+AsynchronousImageFileReader<TOutputImage>
+::ReaderThreadCallback( void *arg )
+{
+  Self * reader = (Self *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+  reader->ReadQueuedFiles();
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TOutputImage>
+void
+AsynchronousImageFileReader<TOutputImage>
+::ReadQueuedFiles()
+{
+  m_Lock.Lock();
+  for (;;)
+    {
+    // Wait for a file to read and for room to keep its image
+    while ( !m_Terminate
+            && ( m_NumberOfDoneRequests == m_Requests.size()
+                 || m_NumberOfDoneRequests >= m_MaximumNumberOfReadAheadImages ) )
+      {
+      m_Condition->Wait( &m_Lock );
+      }
+    if ( m_Terminate )
+      {
+      break;
+      }
+    const std::string fileName = m_Requests[m_NumberOfDoneRequests].FileName;
+    m_Lock.Unlock();
+
+    // Read without holding the lock
+    OutputImagePointer image;
+    std::string error;
+    try
+      {
+      typename ReaderType::Pointer reader = ReaderType::New();
+      reader->SetFileName( fileName.c_str() );
+      reader->Update();
+      image = reader->GetOutput();
+      image->DisconnectPipeline();
+      }
+    catch( ExceptionObject & err )
+      {
+      error = err.GetDescription();
+      }
+
+    m_Lock.Lock();
+    Request & request = m_Requests[m_NumberOfDoneRequests];
+    request.Image = image;
+    request.Error = error;
+    request.Done = true;
+    m_NumberOfDoneRequests++;
+    m_Condition->Broadcast();
+    }
+  m_Lock.Unlock();
+}
+
+template <class TOutputImage>
+void
+AsynchronousImageFileReader<TOutputImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "MaximumNumberOfReadAheadImages: "
+     << m_MaximumNumberOfReadAheadImages << std::endl;
+  os << indent << "NumberOfDoneRequests: " << m_NumberOfDoneRequests
+     << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,150 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkAsynchronousImageFileWriter_h
+#define __itkAsynchronousImageFileWriter_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkImageFileWriter.h"
+#include "itkMultiThreader.h"
+#include "itkSimpleMutexLock.h"
+#include "itkConditionVariable.h"
+#include "itkNumericTraits.h"
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace itk
+{
+
+/** \class AsynchronousImageFileWriter
+ * \brief Writes images on a background thread.
+ *
+ * Write() queues an image and returns at once, so the caller can work on
+ * the next image while the file is written by an ImageFileWriter. Files are
+ * written in the order they were queued. When
+ * MaximumNumberOfPendingImages images are already waiting, Write() waits
+ * for one of them to be written. The queued image must not be modified
+ * until it is written; pass an image disconnected from its pipeline.
+ *
+ * Write errors do not stop the following writes. They are collected and
+ * returned by Flush(), which waits until every queued image is written.
+ * The background thread is started by the first Write() and ends with the
+ * object, after the remaining images are written.
+ *
+ * \sa AsynchronousImageFileReader
+ */
+template <class TInputImage>
+class ITK_EXPORT AsynchronousImageFileWriter : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef AsynchronousImageFileWriter  Self;
+  typedef Object                       Superclass;
+  typedef SmartPointer<Self>           Pointer;
+  typedef SmartPointer<const Self>     ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(AsynchronousImageFileWriter, Object);
+
+  typedef TInputImage                           InputImageType;
+  typedef typename InputImageType::Pointer      InputImagePointer;
+  typedef ImageFileWriter<InputImageType>       WriterType;
+
+  /** A file that could not be written and the reason */
+  struct Failure
+    {
+    std::string FileName;
+    std::string Error;
+    };
+  typedef std::vector<Failure>                  FailureListType;
+
+  /** Number of images that may wait to be written, including the one being
+   * written. Default is 1. */
+  itkSetClampMacro( MaximumNumberOfPendingImages, unsigned int,
+                    1, NumericTraits<unsigned int>::max() );
+  itkGetConstMacro( MaximumNumberOfPendingImages, unsigned int );
+
+  /** Compress the written files when the format supports it. Applies to
+   * the images queued after the call. Default is off. */
+  itkSetMacro( UseCompression, bool );
+  itkGetConstMacro( UseCompression, bool );
+  itkBooleanMacro( UseCompression );
+
+  /** Queue an image to be written to fileName. */
+  void Write( InputImageType * image, const std::string & fileName );
+
+  /** Wait until all the queued images are written and return the files that
+   * failed since the previous Flush(). */
+  FailureListType Flush();
+
+protected:
+  AsynchronousImageFileWriter();
+  ~AsynchronousImageFileWriter();
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+private:
+  AsynchronousImageFileWriter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  /** A queued image and where to write it */
+  struct Request
+    {
+    InputImagePointer Image;
+    std::string       FileName;
+    bool              UseCompression;
+    };
+
+  /** Entry point of the background thread */
+  static ITK_THREAD_RETURN_TYPE WriterThreadCallback( void *arg );
+
+  /** Write the queued images until the object is destroyed */
+  void WriteQueuedImages();
+
+  unsigned int                 m_MaximumNumberOfPendingImages;
+  bool                         m_UseCompression;
+
+  MultiThreader::Pointer       m_Threader;
+  int                          m_ThreadID;
+  bool                         m_ThreadRunning;
+  bool                         m_Terminate;
+
+  /** Queued requests; the first one is being written while m_Busy */
+  std::deque<Request>          m_Requests;
+  bool                         m_Busy;
+  FailureListType              m_Failures;
+  SimpleMutexLock              m_Lock;
+  ConditionVariable::Pointer   m_Condition;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkAsynchronousImageFileWriter.txx"
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkAsynchronousImageFileWriter_txx
+#define __itkAsynchronousImageFileWriter_txx
+
+#include "itkAsynchronousImageFileWriter.h"
+
+namespace itk
+{
+
+template <class TInputImage>
+AsynchronousImageFileWriter<TInputImage>
+::AsynchronousImageFileWriter()
+{
+  m_MaximumNumberOfPendingImages = 1;
+  m_UseCompression = false;
+  m_Threader = MultiThreader::New();
+  m_ThreadID = -1;
+  m_ThreadRunning = false;
+  m_Terminate = false;
+  m_Busy = false;
+  m_Condition = ConditionVariable::New();
+}
+
+template <class TInputImage>
+AsynchronousImageFileWriter<TInputImage>
+::~AsynchronousImageFileWriter()
+{
+  if ( m_ThreadRunning )
+    {
+    // The thread writes what is left before it ends
+    m_Lock.Lock();
+    m_Terminate = true;
+    m_Condition->Broadcast();
+    m_Lock.Unlock();
+    m_Threader->TerminateThread( m_ThreadID );
+    }
+}
+
+template <class TInputImage>
+void
+AsynchronousImageFileWriter<TInputImage>
+::Write( InputImageType * image, const std::string & fileName )
+{
+  if ( !image )
+    {
+    itkExceptionMacro( << "No image to write to " << fileName );
+    }
+
+  Request request;
+  request.Image = image;
+  request.FileName = fileName;
+  request.UseCompression = m_UseCompression;
+
+  if ( !m_ThreadRunning )
+    {
+    m_ThreadID = m_Threader->SpawnThread( Self::WriterThreadCallback, this );
+    m_ThreadRunning = true;
+    }
+
+  m_Lock.Lock();
+  while ( m_Requests.size() >= m_MaximumNumberOfPendingImages )
+    {
+    m_Condition->Wait( &m_Lock );
+    }
+  m_Requests.push_back( request );
+  m_Condition->Broadcast();
+  m_Lock.Unlock();
+}
+
+template <class TInputImage>
+typename AsynchronousImageFileWriter<TInputImage>::FailureListType
+AsynchronousImageFileWriter<TInputImage>
+::Flush()
+{
+  m_Lock.Lock();
+  while ( !m_Requests.empty() )
+    {
+    m_Condition->Wait( &m_Lock );
+    }
+  FailureListType failures;
+  failures.swap( m_Failures );
+  m_Lock.Unlock();
+  return failures;
+}
+
+template <class TInputImage>
+ITK_THREAD_RETURN_TYPE
+AsynchronousImageFileWriter<TInputImage>
+::WriterThreadCallback( void *arg )
+{
+  Self * writer = (Self *)
+    (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+  writer->WriteQueuedImages();
+  return ITK_THREAD_RETURN_VALUE;
+}
+
+template <class TInputImage>
+void
+AsynchronousImageFileWriter<TInputImage>
+::WriteQueuedImages()
+{
+  m_Lock.Lock();
+  for (;;)
+    {
+    while ( !m_Terminate && m_Requests.empty() )
+      {
+      m_Condition->Wait( &m_Lock );
+      }
+    if ( m_Requests.empty() )
+      {
+      break;
+      }
+    // The request stays queued while it is written so that Flush() and
+    // Write() count it as pending
+    const Request request = m_Requests.front();
+    m_Busy = true;
+    m_Lock.Unlock();
+
+    std::string error;
+    try
+      {
+      typename WriterType::Pointer writer = WriterType::New();
+      writer->SetFileName( request.FileName.c_str() );
+      writer->SetInput( request.Image );
+      writer->SetUseCompression( request.UseCompression );
+      writer->Update();
+      }
+    catch( ExceptionObject & err )
+      {
+      error = err.GetDescription();
+      }
+
+    m_Lock.Lock();
+    if ( !error.empty() )
+      {
+      Failure failure;
+      failure.FileName = request.FileName;
+      failure.Error = error;
+      m_Failures.push_back( failure );
+      }
+    m_Requests.pop_front();
+    m_Busy = false;
+    m_Condition->Broadcast();
+    }
+  m_Lock.Unlock();
+}
+
+template <class TInputImage>
+void
+AsynchronousImageFileWriter<TInputImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "MaximumNumberOfPendingImages: "
+     << m_MaximumNumberOfPendingImages << std::endl;
+  os << indent << "UseCompression: " << m_UseCompression << std::endl;
+  os << indent << "Busy: " << m_Busy << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,116 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkImageRegionWorkQueue_h
+#define __itkImageRegionWorkQueue_h
+
+#include "itkImageRegion.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <vector>
+
+namespace itk
+{
+
+/** \class ImageRegionWorkQueue
+ * \brief Hands out the rows of an image region to threads in chunks.
+ *
+ * The region is cut into chunks of whole rows along the first axis. A
+ * chunk holds consecutive rows along the second axis and never crosses a
+ * slice, so it is a region itself. The chunks are dealt out to the threads
+ * as contiguous runs, which keeps the memory a thread touches together.
+ * Each thread takes the chunks of its own run from the front. When its run
+ * is empty it steals chunks from the back of the runs of the other
+ * threads, so a thread that finishes early keeps working instead of
+ * waiting for the slowest one. Each run has its own lock, which is only
+ * contended when a thread steals.
+ *
+ * Initialize() must be called before the threads start, and the threads
+ * must not outlive the queue.
+ *
+ * \sa ImageSource::SplitRequestedRegion
+ */
+template < unsigned int VImageDimension >
+class ImageRegionWorkQueue
+{
+public:
+  typedef ImageRegion< VImageDimension >     RegionType;
+  typedef typename RegionType::IndexType     IndexType;
+  typedef typename RegionType::SizeType      SizeType;
+  typedef typename RegionType::SizeValueType SizeValueType;
+
+  ImageRegionWorkQueue();
+  ~ImageRegionWorkQueue();
+
+  /** Cut region into about numberOfThreads * chunksPerThread chunks and deal
+   * them out to numberOfThreads threads. */
+  void Initialize( const RegionType & region, unsigned int numberOfThreads,
+                   unsigned int chunksPerThread = 8 );
+
+  /** Get the next chunk for thread threadId. Returns false once every
+   * chunk has been taken. With steal set to false the thread only gets the
+   * chunks of its own run, which is how the buffers are first touched by
+   * the thread that later processes them. */
+  bool GetNextChunk( unsigned int threadId, RegionType & chunk,
+                     bool steal = true );
+
+  /** Number of chunks the region was cut into. */
+  SizeValueType GetNumberOfChunks() const
+    {
+    return m_NumberOfChunks;
+    }
+
+  /** Number of rows along the second axis in a chunk. */
+  SizeValueType GetNumberOfRowsPerChunk() const
+    {
+    return m_RowsPerChunk;
+    }
+
+private:
+  ImageRegionWorkQueue(const ImageRegionWorkQueue &); //purposely not implemented
+  void operator=(const ImageRegionWorkQueue &); //purposely not implemented
+
+  /** The chunks [Begin, End) not yet taken from the run of one thread. */
+  struct ThreadRun
+    {
+    SimpleFastMutexLock Lock;
+    SizeValueType       Begin;
+    SizeValueType       End;
+    };
+
+  /** Region of chunk number chunkId. */
+  RegionType GetChunk( SizeValueType chunkId ) const;
+
+  RegionType              m_Region;
+  SizeValueType           m_RowsPerChunk;
+  SizeValueType           m_ChunksPerSlice;
+  SizeValueType           m_NumberOfChunks;
+  std::vector<ThreadRun*> m_Runs;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkImageRegionWorkQueue.txx"
+#endif
+
+#endif
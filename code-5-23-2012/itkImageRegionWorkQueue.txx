@@ -0,0 +1,205 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkImageRegionWorkQueue_txx
+#define __itkImageRegionWorkQueue_txx
+
+#include "itkImageRegionWorkQueue.h"
+
+namespace itk
+{
+
+template < unsigned int VImageDimension >
+ImageRegionWorkQueue< VImageDimension >
+::ImageRegionWorkQueue()
+{
+  m_RowsPerChunk = 0;
+  m_ChunksPerSlice = 0;
+  m_NumberOfChunks = 0;
+}
+
+template < unsigned int VImageDimension >
+ImageRegionWorkQueue< VImageDimension >
+::~ImageRegionWorkQueue()
+{
+  for ( unsigned int t = 0; t < m_Runs.size(); t++ )
+    {
+    delete m_Runs[t];
+    }
+}
+
+template < unsigned int VImageDimension >
+void
+ImageRegionWorkQueue< VImageDimension >
+::Initialize( const RegionType & region, unsigned int numberOfThreads,
+              unsigned int chunksPerThread )
+{
+  m_Region = region;
+
+  if ( numberOfThreads < 1 )
+    {
+    numberOfThreads = 1;
+    }
+  if ( chunksPerThread < 1 )
+    {
+    chunksPerThread = 1;
+    }
+
+  // Rows along the second axis and slices over the remaining axes
+  const SizeType & size = region.GetSize();
+  SizeValueType numberOfRows = 1;
+  SizeValueType numberOfSlices = 1;
+  if ( VImageDimension > 1 )
+    {
+    numberOfRows = size[VImageDimension > 1 ? 1 : 0];
+    }
+  for ( unsigned int i = 2; i < VImageDimension; i++ )
+    {
+    numberOfSlices *= size[i];
+    }
+
+  if ( region.GetNumberOfPixels() == 0 )
+    {
+    m_RowsPerChunk = 0;
+    m_ChunksPerSlice = 0;
+    m_NumberOfChunks = 0;
+    }
+  else
+    {
+    const SizeValueType targetNumberOfChunks =
+      static_cast<SizeValueType>( numberOfThreads ) * chunksPerThread;
+    m_RowsPerChunk = ( numberOfRows * numberOfSlices ) / targetNumberOfChunks;
+    if ( m_RowsPerChunk < 1 )
+      {
+      m_RowsPerChunk = 1;
+      }
+    if ( m_RowsPerChunk > numberOfRows )
+      {
+      m_RowsPerChunk = numberOfRows;
+      }
+    m_ChunksPerSlice = ( numberOfRows + m_RowsPerChunk - 1 ) / m_RowsPerChunk;
+    m_NumberOfChunks = m_ChunksPerSlice * numberOfSlices;
+    }
+
+  // Deal out contiguous runs of chunks
+  for ( unsigned int t = numberOfThreads; t < m_Runs.size(); t++ )
+    {
+    delete m_Runs[t];
+    }
+  const unsigned int previousNumberOfRuns = m_Runs.size();
+  m_Runs.resize( numberOfThreads );
+  for ( unsigned int t = previousNumberOfRuns; t < numberOfThreads; t++ )
+    {
+    m_Runs[t] = new ThreadRun;
+    }
+  for ( unsigned int t = 0; t < numberOfThreads; t++ )
+    {
+    m_Runs[t]->Begin = ( m_NumberOfChunks * t ) / numberOfThreads;
+    m_Runs[t]->End = ( m_NumberOfChunks * ( t + 1 ) ) / numberOfThreads;
+    }
+}
+
+template < unsigned int VImageDimension >
+bool
+ImageRegionWorkQueue< VImageDimension >
+::GetNextChunk( unsigned int threadId, RegionType & chunk, bool steal )
+{
+  const unsigned int numberOfRuns = m_Runs.size();
+  if ( threadId >= numberOfRuns )
+    {
+    return false;
+    }
+
+  // Take from the front of the own run
+  ThreadRun * run = m_Runs[threadId];
+  run->Lock.Lock();
+  if ( run->Begin < run->End )
+    {
+    const SizeValueType chunkId = run->Begin++;
+    run->Lock.Unlock();
+    chunk = this->GetChunk( chunkId );
+    return true;
+    }
+  run->Lock.Unlock();
+
+  if ( !steal )
+    {
+    return false;
+    }
+
+  // Steal from the back of the other runs, starting with the next thread
+  for ( unsigned int i = 1; i < numberOfRuns; i++ )
+    {
+    ThreadRun * victim = m_Runs[( threadId + i ) % numberOfRuns];
+    victim->Lock.Lock();
+    if ( victim->Begin < victim->End )
+      {
+      const SizeValueType chunkId = --victim->End;
+      victim->Lock.Unlock();
+      chunk = this->GetChunk( chunkId );
+      return true;
+      }
+    victim->Lock.Unlock();
+    }
+
+  return false;
+}
+
+template < unsigned int VImageDimension >
+typename ImageRegionWorkQueue< VImageDimension >::RegionType
+ImageRegionWorkQueue< VImageDimension >
+::GetChunk( SizeValueType chunkId ) const
+{
+  IndexType index = m_Region.GetIndex();
+  SizeType  size  = m_Region.GetSize();
+
+  if ( VImageDimension > 1 )
+    {
+    const unsigned int rowAxis = VImageDimension > 1 ? 1 : 0;
+    const SizeValueType firstRow = ( chunkId % m_ChunksPerSlice ) * m_RowsPerChunk;
+    index[rowAxis] += static_cast<typename IndexType::IndexValueType>( firstRow );
+    size[rowAxis] = m_RowsPerChunk;
+    if ( firstRow + m_RowsPerChunk > m_Region.GetSize()[rowAxis] )
+      {
+      size[rowAxis] = m_Region.GetSize()[rowAxis] - firstRow;
+      }
+
+    // One slice over the remaining axes
+    SizeValueType slice = chunkId / m_ChunksPerSlice;
+    for ( unsigned int i = 2; i < VImageDimension; i++ )
+      {
+      index[i] += static_cast<typename IndexType::IndexValueType>(
+        slice % m_Region.GetSize()[i] );
+      size[i] = 1;
+      slice /= m_Region.GetSize()[i];
+      }
+    }
+
+  RegionType chunk;
+  chunk.SetIndex( index );
+  chunk.SetSize( size );
+  return chunk;
+}
+
+} // end namespace itk
+
+#endif
@@ -0,0 +1,130 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkMemoryMappedMetaImageReader_h
+#define __itkMemoryMappedMetaImageReader_h
+
+#include "itkImageSource.h"
+#include "itkImportImageContainer.h"
+
+#include <string>
+
+namespace itk
+{
+
+/** \class MemoryMappedMetaImageReader
+ * \brief Reads an uncompressed MetaImage by mapping its pixel data in memory.
+ *
+ * The output image uses the pixels of the file where they are: the data
+ * file is mapped copy-on-write and the mapping is the pixel buffer of the
+ * output, so nothing is read or copied until the pixels are touched and
+ * the file is never modified. The diffusion filters convert the pixels to
+ * their output type in CopyInputToOutput(), which makes the mapped input
+ * the only copy of the file data that the pipeline holds.
+ *
+ * Both .mhd/.raw pairs and .mha files are supported, as long as the data
+ * is not compressed, has one component per pixel, is stored in a single
+ * file and matches the pixel type and the byte order of the output. Other
+ * files must be read with ImageFileReader. When the system cannot map
+ * files, or the pixels are not aligned in the file, the data is read into
+ * a buffer instead.
+ *
+ * The output is always the largest possible region; the reader does not
+ * stream.
+ *
+ * \sa ImageFileReader
+ */
+template <class TOutputImage>
+class ITK_EXPORT MemoryMappedMetaImageReader : public ImageSource<TOutputImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef MemoryMappedMetaImageReader  Self;
+  typedef ImageSource<TOutputImage>    Superclass;
+  typedef SmartPointer<Self>           Pointer;
+  typedef SmartPointer<const Self>     ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(MemoryMappedMetaImageReader, ImageSource);
+
+  /** Dimension of the output image. */
+  itkStaticConstMacro(ImageDimension, unsigned int,
+                      TOutputImage::ImageDimension);
+
+  typedef TOutputImage                              OutputImageType;
+  typedef typename OutputImageType::PixelType       PixelType;
+  typedef typename OutputImageType::PixelContainer  PixelContainerType;
+  typedef typename OutputImageType::RegionType      RegionType;
+  typedef typename OutputImageType::SizeType        SizeType;
+  typedef typename OutputImageType::SpacingType     SpacingType;
+  typedef typename OutputImageType::PointType       PointType;
+  typedef typename OutputImageType::DirectionType   DirectionType;
+
+  /** Name of the .mhd or .mha file to read. */
+  itkSetStringMacro( FileName );
+  itkGetStringMacro( FileName );
+
+  /** True when the last Update() mapped the file, false when the pixels
+   * were read into a buffer. */
+  itkGetConstMacro( MemoryMapped, bool );
+
+protected:
+  MemoryMappedMetaImageReader();
+  ~MemoryMappedMetaImageReader() {}
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  /** Read the header: size, spacing, origin, direction and data layout. */
+  void GenerateOutputInformation();
+
+  /** The whole image is always produced. */
+  void EnlargeOutputRequestedRegion(DataObject *output);
+
+  /** Map the pixel data and make it the buffer of the output. */
+  void GenerateData();
+
+private:
+  MemoryMappedMetaImageReader(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  /** Name of the MetaImage element type that matches PixelType, or an
+   * empty string when there is none. */
+  static std::string GetElementTypeOfPixelType();
+
+  std::string          m_FileName;
+  bool                 m_MemoryMapped;
+
+  /** Where the pixels are, as found by GenerateOutputInformation() */
+  std::string          m_DataFileName;
+  long                 m_DataOffset;
+  long                 m_HeaderSize;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkMemoryMappedMetaImageReader.txx"
+#endif
+
+#endif
@@ -0,0 +1,398 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkMemoryMappedMetaImageReader_txx
+#define __itkMemoryMappedMetaImageReader_txx
+
+#include "itkMemoryMappedMetaImageReader.h"
+#include "itkByteSwapper.h"
+
+#include <fstream>
+#include <sstream>
+#include <typeinfo>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace itk
+{
+
+namespace MemoryMappedMetaImage
+{
+
+/** \class MappedPixelContainer
+ * \brief Pixel container whose buffer is a mapping of a file. The mapping
+ * is removed when the container is destroyed. */
+template <class TPixelContainer>
+class MappedPixelContainer : public TPixelContainer
+{
+public:
+  typedef MappedPixelContainer     Self;
+  typedef TPixelContainer          Superclass;
+  typedef SmartPointer<Self>       Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  itkNewMacro(Self);
+  itkTypeMacro(MappedPixelContainer, ImportImageContainer);
+
+  /** Keep the mapping that holds the buffer */
+  void SetMapping( void * address, size_t length )
+    {
+    m_MappingAddress = address;
+    m_MappingLength = length;
+    }
+
+protected:
+  MappedPixelContainer() : m_MappingAddress( 0 ), m_MappingLength( 0 ) {}
+  ~MappedPixelContainer()
+    {
+#if !defined(_WIN32)
+    if ( m_MappingAddress )
+      {
+      munmap( m_MappingAddress, m_MappingLength );
+      }
+#endif
+    }
+
+private:
+  MappedPixelContainer(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  void *  m_MappingAddress;
+  size_t  m_MappingLength;
+};
+
+} // end namespace MemoryMappedMetaImage
+
+template <class TOutputImage>
+MemoryMappedMetaImageReader<TOutputImage>
+::MemoryMappedMetaImageReader()
+{
+  m_MemoryMapped = false;
+  m_DataOffset = 0;
+  m_HeaderSize = 0;
+}
+
+template <class TOutputImage>
+std::string
+MemoryMappedMetaImageReader<TOutputImage>
+::GetElementTypeOfPixelType()
+{
+  if ( typeid(PixelType) == typeid(char) ||
+       typeid(PixelType) == typeid(signed char) ) { return "MET_CHAR"; }
+  if ( typeid(PixelType) == typeid(unsigned char) ) { return "MET_UCHAR"; }
+  if ( typeid(PixelType) == typeid(short) ) { return "MET_SHORT"; }
+  if ( typeid(PixelType) == typeid(unsigned short) ) { return "MET_USHORT"; }
+  if ( typeid(PixelType) == typeid(int) ) { return "MET_INT"; }
+  if ( typeid(PixelType) == typeid(unsigned int) ) { return "MET_UINT"; }
+  if ( typeid(PixelType) == typeid(float) ) { return "MET_FLOAT"; }
+  if ( typeid(PixelType) == typeid(double) ) { return "MET_DOUBLE"; }
+  return "";
+}
+
+template <class TOutputImage>
+void
+MemoryMappedMetaImageReader<TOutputImage>
+::GenerateOutputInformation()
+{
+  OutputImageType * output = this->GetOutput();
+
+  std::ifstream header( m_FileName.c_str(), std::ios::in | std::ios::binary );
+  if ( !header )
+    {
+    itkExceptionMacro( << "Cannot open " << m_FileName );
+    }
+
+  unsigned int numberOfDimensions = 0;
+  SizeType size;
+  size.Fill( 0 );
+  SpacingType spacing;
+  spacing.Fill( 1.0 );
+  PointType origin;
+  origin.Fill( 0.0 );
+  DirectionType direction;
+  direction.SetIdentity();
+  std::string elementType;
+  bool byteOrderMSB = false;
+  m_DataFileName = "";
+  m_HeaderSize = 0;
+
+  // The header is a list of "Key = Value" lines ending with ElementDataFile
+  std::string line;
+  while ( m_DataFileName.empty() && std::getline( header, line ) )
+    {
+    const std::string::size_type equal = line.find( '=' );
+    if ( equal == std::string::npos )
+      {
+      continue;
+      }
+    std::istringstream keyStream( line.substr( 0, equal ) );
+    std::string key;
+    keyStream >> key;
+    std::istringstream value( line.substr( equal + 1 ) );
+
+    if ( key == "NDims" )
+      {
+      value >> numberOfDimensions;
+      }
+    else if ( key == "DimSize" )
+      {
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        value >> size[i];
+        }
+      }
+    else if ( key == "ElementSpacing" )
+      {
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        value >> spacing[i];
+        }
+      }
+    else if ( key == "Offset" || key == "Position" || key == "Origin" )
+      {
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        value >> origin[i];
+        }
+      }
+    else if ( key == "TransformMatrix" || key == "Rotation"
+              || key == "Orientation" )
+      {
+      // Row i of the matrix is the direction of axis i
+      for ( unsigned int i = 0; i < ImageDimension; i++ )
+        {
+        for ( unsigned int j = 0; j < ImageDimension; j++ )
+          {
+          value >> direction[j][i];
+          }
+        }
+      }
+    else if ( key == "ElementType" )
+      {
+      value >> elementType;
+      }
+    else if ( key == "BinaryDataByteOrderMSB" || key == "ElementByteOrderMSB" )
+      {
+      std::string flag;
+      value >> flag;
+      byteOrderMSB = ( flag == "True" || flag == "true" || flag == "1" );
+      }
+    else if ( key == "CompressedData" )
+      {
+      std::string flag;
+      value >> flag;
+      if ( flag == "True" || flag == "true" || flag == "1" )
+        {
+        itkExceptionMacro( << m_FileName << " is compressed and cannot be "
+                           << "mapped; use ImageFileReader." );
+        }
+      }
+    else if ( key == "ElementNumberOfChannels" )
+      {
+      unsigned int numberOfChannels = 1;
+      value >> numberOfChannels;
+      if ( numberOfChannels != 1 )
+        {
+        itkExceptionMacro( << m_FileName << " has " << numberOfChannels
+                           << " components per pixel; only scalar images "
+                           << "can be mapped." );
+        }
+      }
+    else if ( key == "HeaderSize" )
+      {
+      value >> m_HeaderSize;
+      }
+    else if ( key == "ElementDataFile" )
+      {
+      value >> m_DataFileName;
+      }
+    }
+
+  if ( m_DataFileName.empty() )
+    {
+    itkExceptionMacro( << m_FileName << " is not a MetaImage header: "
+                       << "ElementDataFile is missing." );
+    }
+  if ( numberOfDimensions != ImageDimension )
+    {
+    itkExceptionMacro( << m_FileName << " has " << numberOfDimensions
+                       << " dimensions, the output has " << ImageDimension );
+    }
+  if ( elementType != GetElementTypeOfPixelType() )
+    {
+    itkExceptionMacro( << m_FileName << " holds " << elementType
+                       << " pixels, which do not match the output pixel "
+                       << "type; use ImageFileReader." );
+    }
+  if ( byteOrderMSB != ByteSwapper<PixelType>::SystemIsBigEndian() )
+    {
+    itkExceptionMacro( << "The byte order of " << m_FileName
+                       << " is not the byte order of this system; use "
+                       << "ImageFileReader." );
+    }
+
+  if ( m_DataFileName == "LOCAL" )
+    {
+    // The pixels follow the header in the same file
+    m_DataFileName = m_FileName;
+    m_DataOffset = static_cast<long>( header.tellg() );
+    }
+  else
+    {
+    if ( m_DataFileName == "LIST" || m_DataFileName.find( '%' ) != std::string::npos )
+      {
+      itkExceptionMacro( << m_FileName << " stores its pixels in several "
+                         << "files, which cannot be mapped; use "
+                         << "ImageFileReader." );
+      }
+    // A relative data file name is relative to the header
+    const std::string::size_type slash = m_FileName.find_last_of( "/\\" );
+    if ( slash != std::string::npos && m_DataFileName[0] != '/' )
+      {
+      m_DataFileName = m_FileName.substr( 0, slash + 1 ) + m_DataFileName;
+      }
+    m_DataOffset = 0;
+    }
+
+  RegionType region;
+  region.SetSize( size );
+  output->SetLargestPossibleRegion( region );
+  output->SetSpacing( spacing );
+  output->SetOrigin( origin );
+  output->SetDirection( direction );
+}
+
+template <class TOutputImage>
+void
+MemoryMappedMetaImageReader<TOutputImage>
+::EnlargeOutputRequestedRegion(DataObject *output)
+{
+  OutputImageType * image = dynamic_cast<OutputImageType *>( output );
+  if ( image )
+    {
+    image->SetRequestedRegionToLargestPossibleRegion();
+    }
+}
+
+template <class TOutputImage>
+void
+MemoryMappedMetaImageReader<TOutputImage>
+::GenerateData()
+{
+  OutputImageType * output = this->GetOutput();
+  output->SetBufferedRegion( output->GetRequestedRegion() );
+
+  const unsigned long numberOfPixels =
+    output->GetLargestPossibleRegion().GetNumberOfPixels();
+  const size_t dataLength = numberOfPixels * sizeof( PixelType );
+
+  // Find where the pixels start. A HeaderSize of -1 puts them at the end
+  // of the data file.
+  std::ifstream data( m_DataFileName.c_str(), std::ios::in | std::ios::binary );
+  if ( !data )
+    {
+    itkExceptionMacro( << "Cannot open the data file " << m_DataFileName );
+    }
+  data.seekg( 0, std::ios::end );
+  const long fileLength = static_cast<long>( data.tellg() );
+  long dataOffset = m_DataOffset;
+  if ( m_HeaderSize == -1 )
+    {
+    dataOffset = fileLength - static_cast<long>( dataLength );
+    }
+  else
+    {
+    dataOffset += m_HeaderSize;
+    }
+  if ( dataOffset < 0 || dataOffset + static_cast<long>( dataLength ) > fileLength )
+    {
+    itkExceptionMacro( << m_DataFileName << " is too short for "
+                       << numberOfPixels << " pixels." );
+    }
+
+  m_MemoryMapped = false;
+
+#if !defined(_WIN32)
+  // The mapping starts on a page boundary; the pixels must also be aligned
+  // for their type to be used in place
+  const long pageSize = sysconf( _SC_PAGESIZE );
+  const long mappingOffset = ( dataOffset / pageSize ) * pageSize;
+  const long skip = dataOffset - mappingOffset;
+  if ( skip % sizeof( PixelType ) == 0 && dataLength > 0 )
+    {
+    const int fd = open( m_DataFileName.c_str(), O_RDONLY );
+    if ( fd >= 0 )
+      {
+      const size_t mappingLength = dataLength + skip;
+      // Private mapping: writing to the pixels never changes the file
+      void * address = mmap( 0, mappingLength, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, fd, mappingOffset );
+      close( fd );
+      if ( address != MAP_FAILED )
+        {
+        typedef MemoryMappedMetaImage::MappedPixelContainer<PixelContainerType>
+          MappedPixelContainerType;
+        typename MappedPixelContainerType::Pointer container =
+          MappedPixelContainerType::New();
+        container->SetImportPointer(
+          reinterpret_cast<PixelType *>( static_cast<char *>( address ) + skip ),
+          numberOfPixels, false );
+        container->SetMapping( address, mappingLength );
+        output->SetPixelContainer( container );
+        m_MemoryMapped = true;
+        return;
+        }
+      }
+    }
+#endif
+
+  // Read the pixels into a buffer of their own, never into the mapping of
+  // a previous update
+  output->SetPixelContainer( PixelContainerType::New() );
+  output->Allocate();
+  data.seekg( dataOffset, std::ios::beg );
+  data.read( reinterpret_cast<char *>( output->GetBufferPointer() ), dataLength );
+  if ( !data )
+    {
+    itkExceptionMacro( << "Cannot read the pixels of " << m_DataFileName );
+    }
+}
+
+template <class TOutputImage>
+void
+MemoryMappedMetaImageReader<TOutputImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "FileName: " << m_FileName << std::endl;
+  os << indent << "DataFileName: " << m_DataFileName << std::endl;
+  os << indent << "MemoryMapped: " << m_MemoryMapped << std::endl;
+}
+
+} // end namespace itk
+
+#endif
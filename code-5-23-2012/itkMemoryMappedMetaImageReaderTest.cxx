@@ -0,0 +1,136 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkMemoryMappedMetaImageReaderTest.cxx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+
+#include "itkMemoryMappedMetaImageReader.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionConstIterator.h"
+
+int main(int argc, char* argv [] )
+{
+  if ( argc < 2 )
+    {
+    std::cerr << "Missing Parameters: " 
+              << argv[0]
+              << " Input_Image [ExpectMemoryMapped]"
+              << std::endl; 
+    return EXIT_FAILURE;
+    }
+
+  const unsigned int Dimension = 3;
+  typedef short       PixelType;
+  typedef itk::Image< PixelType, Dimension>  ImageType;
+
+  typedef itk::MemoryMappedMetaImageReader< ImageType >  MappedReaderType;
+  typedef itk::ImageFileReader< ImageType >              ReaderType;
+
+  MappedReaderType::Pointer mappedReader = MappedReaderType::New();
+  mappedReader->SetFileName( argv[1] );
+  ReaderType::Pointer reader = ReaderType::New();
+  reader->SetFileName( argv[1] );
+
+  std::cout << "Reading input image : " << argv[1] << std::endl;
+  try
+    {
+    mappedReader->Update();
+    reader->Update();
+    }
+  catch ( itk::ExceptionObject &err )
+    {
+    std::cerr << "Exception thrown: " << err << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  mappedReader->Print( std::cout );
+
+  // The pixels must have been mapped, not read, unless the file does not
+  // allow it. Windows always reads them.
+  bool expectMemoryMapped = true;
+  if ( argc > 2 )
+    {
+    expectMemoryMapped = atoi( argv[2] ) != 0;
+    }
+#if defined(_WIN32)
+  expectMemoryMapped = false;
+#endif
+  if ( mappedReader->GetMemoryMapped() != expectMemoryMapped )
+    {
+    std::cerr << "The pixels were " 
+              << ( mappedReader->GetMemoryMapped() ? "" : "not " )
+              << "memory mapped" << std::endl;
+    return EXIT_FAILURE;
+    }
+  ImageType::Pointer mapped = mappedReader->GetOutput();
+  ImageType::ConstPointer expected = reader->GetOutput();
+
+  // Same geometry as ImageFileReader
+  if ( mapped->GetLargestPossibleRegion() != expected->GetLargestPossibleRegion()
+       || mapped->GetSpacing() != expected->GetSpacing()
+       || mapped->GetOrigin() != expected->GetOrigin()
+       || mapped->GetDirection() != expected->GetDirection() )
+    {
+    std::cerr << "The geometry of the mapped image differs:" << std::endl;
+    mapped->Print( std::cerr );
+    expected->Print( std::cerr );
+    return EXIT_FAILURE;
+    }
+
+  // Same pixels
+  itk::ImageRegionConstIterator<ImageType> mappedIt( mapped,
+    mapped->GetLargestPossibleRegion() );
+  itk::ImageRegionConstIterator<ImageType> expectedIt( expected,
+    expected->GetLargestPossibleRegion() );
+  unsigned long numberOfDifferences = 0;
+  while ( !expectedIt.IsAtEnd() )
+    {
+    if ( mappedIt.Get() != expectedIt.Get() )
+      {
+      numberOfDifferences++;
+      }
+    ++mappedIt;
+    ++expectedIt;
+    }
+  if ( numberOfDifferences > 0 )
+    {
+    std::cerr << numberOfDifferences << " pixels differ" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  // Writing to the mapped pixels must not change the file
+  ImageType::IndexType first = mapped->GetLargestPossibleRegion().GetIndex();
+  const PixelType value = mapped->GetPixel( first );
+  mapped->SetPixel( first, value + 1 );
+
+  ReaderType::Pointer rereader = ReaderType::New();
+  rereader->SetFileName( argv[1] );
+  try
+    {
+    rereader->Update();
+    }
+  catch ( itk::ExceptionObject &err )
+    {
+    std::cerr << "Exception thrown: " << err << std::endl;
+    return EXIT_FAILURE;
+    }
+  if ( rereader->GetOutput()->GetPixel( first ) != value )
+    {
+    std::cerr << "Writing to the mapped image changed the file" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
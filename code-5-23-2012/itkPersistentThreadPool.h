@@ -0,0 +1,368 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkPersistentThreadPool_h
+#define __itkPersistentThreadPool_h
+
+#include "itkObject.h"
+#include "itkObjectFactory.h"
+#include "itkMultiThreader.h"
+#include "itkBarrier.h"
+#include "itkSimpleFastMutexLock.h"
+
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace itk
+{
+
+/** \class PersistentThreadPool
+ * \brief Keeps a set of worker threads alive between parallel sections.
+ *
+ * MultiThreader::SingleMethodExecute() creates and joins its threads on
+ * every call. A filter that runs several short parallel sections per
+ * iteration spends a noticeable part of the time doing so. Start() spawns
+ * the workers once. Execute() then runs a callback on every thread, like
+ * SingleMethodExecute(), and the workers wait on a barrier in between.
+ * The calling thread takes part as thread 0.
+ *
+ * The callback receives a MultiThreader::ThreadInfoStruct with the
+ * ThreadID, NumberOfThreads and UserData fields set, so the threader
+ * callbacks of the filters can be used unchanged.
+ *
+ * When PinThreads is on, thread i is bound to the i-th processor the
+ * process may run on. A thread then always runs near the memory it first
+ * touched. The workers stay bound for as long as the pool runs. The
+ * calling thread is only bound while it runs its share of Execute(), since
+ * the threads it creates inherit its processors: outside Execute() it
+ * keeps all of them, and so do the threads of a MultiThreader it starts.
+ * Pinning is only implemented on Linux and is ignored elsewhere.
+ *
+ * Execute() must only be called by the thread that called Start(). An
+ * exception thrown by the callback on any thread is caught there. Once
+ * all the threads are done, Execute() throws an ExceptionObject with the
+ * message of the first one.
+ *
+ * \sa MultiThreader
+ */
+class PersistentThreadPool : public Object
+{
+public:
+  /** Standard class typedefs. */
+  typedef PersistentThreadPool     Self;
+  typedef Object                   Superclass;
+  typedef SmartPointer<Self>       Pointer;
+  typedef SmartPointer<const Self> ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods). */
+  itkTypeMacro(PersistentThreadPool, Object);
+
+  /** Spawn the worker threads. numberOfThreads includes the calling thread
+   * and is clamped to [1, ITK_MAX_THREADS]. A running pool is stopped
+   * first. */
+  void Start( int numberOfThreads )
+    {
+    this->Stop();
+
+    if ( numberOfThreads < 1 )
+      {
+      numberOfThreads = 1;
+      }
+    if ( numberOfThreads > ITK_MAX_THREADS )
+      {
+      numberOfThreads = ITK_MAX_THREADS;
+      }
+
+    m_NumberOfThreads = numberOfThreads;
+    m_Terminate = false;
+    m_Barrier->Initialize( m_NumberOfThreads );
+
+#ifdef __linux__
+    // The processors the process may run on, in order. The workers bind
+    // themselves; the calling thread is bound in Execute() only.
+    m_Processors.clear();
+    if ( m_PinThreads
+         && sched_getaffinity( 0, sizeof(cpu_set_t), &m_CallerAffinity ) == 0 )
+      {
+      for ( int cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+        {
+        if ( CPU_ISSET( cpu, &m_CallerAffinity ) )
+          {
+          m_Processors.push_back( cpu );
+          }
+        }
+      }
+#endif
+
+    for ( int i = 1; i < m_NumberOfThreads; i++ )
+      {
+      m_Workers[i].Pool = this;
+      m_Workers[i].ThreadID = i;
+      m_Workers[i].SpawnedThreadID =
+        m_Threader->SpawnThread( Self::WorkerThread, &m_Workers[i] );
+      }
+    m_Running = true;
+    }
+
+  /** Let the worker threads return and join them. */
+  void Stop()
+    {
+    if ( !m_Running )
+      {
+      return;
+      }
+
+    m_Terminate = true;
+    if ( m_NumberOfThreads > 1 )
+      {
+      m_Barrier->Wait();
+      }
+    for ( int i = 1; i < m_NumberOfThreads; i++ )
+      {
+      m_Threader->TerminateThread( m_Workers[i].SpawnedThreadID );
+      }
+
+    m_Running = false;
+    m_NumberOfThreads = 1;
+    }
+
+  /** Run method on every thread of the pool with data as UserData and
+   * return when all of them are done. */
+  void Execute( ThreadFunctionType method, void *data )
+    {
+    if ( !m_Running )
+      {
+      itkExceptionMacro( << "The thread pool is not running." );
+      }
+
+    m_Method = method;
+    m_UserData = data;
+    m_ExceptionOccurred = false;
+    m_ExceptionDetails = "";
+
+    // Release the workers, do the share of thread 0 and wait for the others
+    if ( m_NumberOfThreads > 1 )
+      {
+      m_Barrier->Wait();
+      }
+
+    // Bind the calling thread for its share only
+    const bool callerPinned = m_PinThreads && this->PinCurrentThread( 0 );
+
+    MultiThreader::ThreadInfoStruct info;
+    info.ThreadID = 0;
+    info.NumberOfThreads = m_NumberOfThreads;
+    info.UserData = m_UserData;
+
+    this->RunMethod( &info );
+
+    if ( callerPinned )
+      {
+      this->RestoreCallerAffinity();
+      }
+
+    if ( m_NumberOfThreads > 1 )
+      {
+      m_Barrier->Wait();
+      }
+
+    // All the threads are past the barrier, so the details are complete
+    if ( m_ExceptionOccurred )
+      {
+      itkExceptionMacro( << "Exception occurred during Execute" << std::endl
+                         << m_ExceptionDetails );
+      }
+    }
+
+  /** Bind each thread to one processor while the pool runs. Takes effect at
+   * the next Start(). Default is off. */
+  itkSetMacro( PinThreads, bool );
+  itkGetConstMacro( PinThreads, bool );
+  itkBooleanMacro( PinThreads );
+
+  /** Number of threads, the calling thread included. */
+  itkGetConstMacro( NumberOfThreads, int );
+
+  /** Whether Start() was called without a matching Stop(). */
+  bool IsRunning() const
+    {
+    return m_Running;
+    }
+
+protected:
+  PersistentThreadPool()
+    {
+    m_Threader = MultiThreader::New();
+    m_Barrier = Barrier::New();
+    m_NumberOfThreads = 1;
+    m_Running = false;
+    m_Terminate = false;
+    m_PinThreads = false;
+    m_Method = 0;
+    m_UserData = 0;
+    m_ExceptionOccurred = false;
+    }
+
+  ~PersistentThreadPool()
+    {
+    this->Stop();
+    }
+
+  void PrintSelf(std::ostream& os, Indent indent) const
+    {
+    Superclass::PrintSelf(os, indent);
+    os << indent << "NumberOfThreads: " << m_NumberOfThreads << std::endl;
+    os << indent << "Running: " << m_Running << std::endl;
+    os << indent << "PinThreads: " << m_PinThreads << std::endl;
+    }
+
+private:
+  PersistentThreadPool(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  struct WorkerStruct
+    {
+    PersistentThreadPool *Pool;
+    int                   ThreadID;
+    int                   SpawnedThreadID;
+    };
+
+  /** Entry point of the worker threads. */
+  static ITK_THREAD_RETURN_TYPE WorkerThread( void *arg )
+    {
+    WorkerStruct *worker = (WorkerStruct *)
+      (((MultiThreader::ThreadInfoStruct *)(arg))->UserData);
+    worker->Pool->RunWorker( worker->ThreadID );
+    return ITK_THREAD_RETURN_VALUE;
+    }
+
+  /** Bind the calling thread to the processor of thread threadId. Returns
+   * true on success. */
+  bool PinCurrentThread( int threadId )
+    {
+#ifdef __linux__
+    if ( m_Processors.empty() )
+      {
+      return false;
+      }
+    cpu_set_t affinity;
+    CPU_ZERO( &affinity );
+    CPU_SET( m_Processors[threadId % m_Processors.size()], &affinity );
+    return sched_setaffinity( 0, sizeof(cpu_set_t), &affinity ) == 0;
+#else
+    (void)threadId;
+    return false;
+#endif
+    }
+
+  /** Run the method of the current Execute() on one thread. An exception
+   * is recorded instead of leaving the thread; only the first is kept. */
+  void RunMethod( MultiThreader::ThreadInfoStruct * info )
+    {
+    std::string details;
+    try
+      {
+      (*m_Method)( info );
+      return;
+      }
+    catch ( std::exception & e )
+      {
+      details = e.what();
+      }
+    catch ( ... )
+      {
+      details = "Unknown exception";
+      }
+
+    m_ExceptionLock.Lock();
+    if ( !m_ExceptionOccurred )
+      {
+      m_ExceptionOccurred = true;
+      m_ExceptionDetails = details;
+      }
+    m_ExceptionLock.Unlock();
+    }
+
+  /** Give the calling thread the processors it had at Start(). */
+  void RestoreCallerAffinity()
+    {
+#ifdef __linux__
+    sched_setaffinity( 0, sizeof(cpu_set_t), &m_CallerAffinity );
+#endif
+    }
+
+  /** Run the method of each Execute() until Stop() is called. */
+  void RunWorker( int threadId )
+    {
+    // The worker threads end with the pool, so they are never unpinned
+    if ( m_PinThreads )
+      {
+      this->PinCurrentThread( threadId );
+      }
+
+    MultiThreader::ThreadInfoStruct info;
+    info.ThreadID = threadId;
+    info.NumberOfThreads = m_NumberOfThreads;
+
+    for (;;)
+      {
+      m_Barrier->Wait();
+      if ( m_Terminate )
+        {
+        break;
+        }
+      info.UserData = m_UserData;
+      this->RunMethod( &info );
+      m_Barrier->Wait();
+      }
+    }
+
+  MultiThreader::Pointer m_Threader;
+  Barrier::Pointer       m_Barrier;
+  WorkerStruct           m_Workers[ITK_MAX_THREADS];
+  int                    m_NumberOfThreads;
+  bool                   m_Running;
+  volatile bool          m_Terminate;
+  bool                   m_PinThreads;
+#ifdef __linux__
+  std::vector<int>       m_Processors;
+  cpu_set_t              m_CallerAffinity;
+#endif
+  ThreadFunctionType     m_Method;
+  void                  *m_UserData;
+
+  /** The first exception of the current Execute() */
+  SimpleFastMutexLock    m_ExceptionLock;
+  bool                   m_ExceptionOccurred;
+  std::string            m_ExceptionDetails;
+};
+
+} // end namespace itk
+
+#endif
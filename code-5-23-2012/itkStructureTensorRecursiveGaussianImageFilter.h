@@ -37,6 +37,8 @@ namespace itk
  *
  * \brief Computes the structure tensor of a multidimensional image
  *
+ * The outer product of the gradient is smoothed in place, all of its
+ * components at once, with a recursive Gaussian of sigma SigmaOuter.
  *
  * \warning Operates in image (pixel) space, not physical space
  *
@@ -143,13 +145,16 @@ protected:
   // Override since the filter produces the entire dataset
   void EnlargeOutputRequestedRegion(DataObject *output);
 
+  /** Smooth all the tensor components of the output in place along one
+   * direction with a third order recursive Gaussian of sigma SigmaOuter. */
+  void SmoothTensorComponents( unsigned int direction );
+
 private:
   StructureTensorRecursiveGaussianImageFilter(const Self&); //purposely not implemented
   void operator=(const Self&); //purposely not implemented
 
   std::vector<GaussianFilterPointer>         m_SmoothingFilters;
   DerivativeFilterPointer                    m_DerivativeFilter;
-  GaussianFilterPointer                      m_TensorComponentSmoothingFilter;
   OutputImageAdaptorPointer                  m_ImageAdaptor;
 
   /** Normalize the image across scale space */
@@ -25,6 +25,10 @@ limitations under the License.
 
 #include "itkStructureTensorRecursiveGaussianImageFilter.h"
 #include "itkImageRegionIteratorWithIndex.h"
+#include "itkImageLinearIteratorWithIndex.h"
+#include "vnl/vnl_math.h"
+
+#include <vector>
 
 namespace itk
 {
@@ -52,12 +56,6 @@ StructureTensorRecursiveGaussianImageFilter<TInputImage,TOutputImage>
     m_SmoothingFilters[ i ]->ReleaseDataFlagOn();
     }
 
-  // Outer Gaussian smoothing filter
-  m_TensorComponentSmoothingFilter = GaussianFilterType::New();
-  m_TensorComponentSmoothingFilter->SetOrder( GaussianFilterType::ZeroOrder );
-  m_TensorComponentSmoothingFilter->SetNormalizeAcrossScale( m_NormalizeAcrossScale );
-  //m_TensorComponentSmoothingFilter->ReleaseDataFlagOn();
- 
   m_DerivativeFilter = DerivativeFilterType::New();
   m_DerivativeFilter->SetOrder( DerivativeFilterType::FirstOrder );
   m_DerivativeFilter->SetNormalizeAcrossScale( m_NormalizeAcrossScale );
@@ -110,7 +108,6 @@ StructureTensorRecursiveGaussianImageFilter<TInputImage,TOutputImage>
 ::SetSigmaOuter( RealType sigma )
 {
   m_SigmaOuter = sigma;
-  m_TensorComponentSmoothingFilter->SetSigma( sigma );
   this->Modified();
 }
 
@@ -187,6 +184,13 @@ StructureTensorRecursiveGaussianImageFilter<TInputImage,TOutputImage >
   progress->RegisterInternalFilter( m_DerivativeFilter, weight );
   progress->ResetProgress();
 
+  // The internal filters run with the threads of this filter
+  for( unsigned int i = 0; i<ImageDimension-1; i++ )
+    {
+    m_SmoothingFilters[i]->SetNumberOfThreads( this->GetNumberOfThreads() );
+    }
+  m_DerivativeFilter->SetNumberOfThreads( this->GetNumberOfThreads() );
+
   const typename TInputImage::ConstPointer   inputImage( this->GetInput() );
 
   m_ImageAdaptor->SetImage( this->GetOutput() );
@@ -290,49 +294,139 @@ StructureTensorRecursiveGaussianImageFilter<TInputImage,TOutputImage >
     ++ottensor;
     }
 
-  //Finally, smooth the outer product components
-  typedef typename itk::Image<InternalRealType, ImageDimension> ComponentImageType;
-    
-  for(unsigned int i =0; i < numberTensorElements; i++)
+  //Finally, smooth the outer product components. All the components are
+  //smoothed together, in place, one direction at a time.
+  for( unsigned int dim=0; dim < ImageDimension; dim++ )
+    {
+    this->SmoothTensorComponents( dim );
+    }
+}
+
+/**
+ * Smooth the tensor components of the output along one direction with the
+ * recursive Gaussian of I. T. Young and L. J. van Vliet, "Recursive
+ * implementation of the Gaussian filter", Signal Processing 44, 1995.
+ * SigmaOuter is measured in pixels.
+ */
+template <typename TInputImage, typename TOutputImage >
+void
+StructureTensorRecursiveGaussianImageFilter<TInputImage,TOutputImage >
+::SmoothTensorComponents( unsigned int direction )
+{
+  OutputImageType * output = this->GetOutput();
+
+  const unsigned int lineLength
+      = output->GetRequestedRegion().GetSize()[ direction ];
+  if( lineLength < 2 )
+    {
+    return;
+    }
+
+  // The coefficients are only valid for sigma >= 0.5
+  double sigma = static_cast< double >( m_SigmaOuter );
+  if( sigma < 0.5 )
+    {
+    sigma = 0.5;
+    }
+
+  double q;
+  if( sigma >= 2.5 )
+    {
+    q = 0.98711 * sigma - 0.96330;
+    }
+  else
+    {
+    q = 3.97156 - 4.14554 * vcl_sqrt( 1.0 - 0.26891 * sigma );
+    }
+
+  const double q2 = q * q;
+  const double q3 = q2 * q;
+  const double b0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+  const double b1 = ( 2.44413 * q + 2.85619 * q2 + 1.26661 * q3 ) / b0;
+  const double b2 = -( 1.4281 * q2 + 1.26661 * q3 ) / b0;
+  const double b3 = 0.422205 * q3 / b0;
+  const double B  = 1.0 - ( b1 + b2 + b3 );
+
+  const unsigned int numberTensorElements
+      = (ImageDimension*(ImageDimension+1))/2;
+
+  // One line of all the components and the last three values of the
+  // recursion for each component
+  std::vector<double> line( lineLength * numberTensorElements );
+  std::vector<double> w1( numberTensorElements );
+  std::vector<double> w2( numberTensorElements );
+  std::vector<double> w3( numberTensorElements );
+
+  ImageLinearIteratorWithIndex< OutputImageType > it(
+    output, output->GetRequestedRegion() );
+  it.SetDirection( direction );
+
+  it.GoToBegin();
+  while( !it.IsAtEnd() )
     {
-    typename ComponentImageType::Pointer componentImage = ComponentImageType::New();
-    componentImage->SetLargestPossibleRegion( inputImage->GetLargestPossibleRegion() );
-    componentImage->SetBufferedRegion( inputImage->GetBufferedRegion() );
-    componentImage->SetRequestedRegion( inputImage->GetRequestedRegion() );
-    componentImage->Allocate();
-    
-    ImageRegionIteratorWithIndex< ComponentImageType > 
-              compit(
-                    componentImage,
-                    componentImage->GetRequestedRegion()
-                    );
-    
-    ottensor.GoToBegin();
-    compit.GoToBegin();
-    while( !compit.IsAtEnd() )
+    double * value = &line[0];
+    while( !it.IsAtEndOfLine() )
+      {
+      const OutputPixelType & pixel = it.Value();
+      for( unsigned int c = 0; c < numberTensorElements; c++ )
+        {
+        *value++ = pixel[c];
+        }
+      ++it;
+      }
+
+    // Causal pass. The line is extended with its first value, which is the
+    // steady state of the recursion for a constant signal.
+    for( unsigned int c = 0; c < numberTensorElements; c++ )
+      {
+      w1[c] = w2[c] = w3[c] = line[c];
+      }
+    value = &line[0];
+    for( unsigned int n = 0; n < lineLength; n++ )
       {
-      compit.Value() = ottensor.Get()[i];
-      ++compit;
-      ++ottensor;
+      for( unsigned int c = 0; c < numberTensorElements; c++ )
+        {
+        const double w = B * value[c] + b1 * w1[c] + b2 * w2[c] + b3 * w3[c];
+        value[c] = w;
+        w3[c] = w2[c];
+        w2[c] = w1[c];
+        w1[c] = w;
+        }
+      value += numberTensorElements;
+      }
+
+    // Anti-causal pass, extended with the last value
+    value = &line[ ( lineLength - 1 ) * numberTensorElements ];
+    for( unsigned int c = 0; c < numberTensorElements; c++ )
+      {
+      w1[c] = w2[c] = w3[c] = value[c];
+      }
+    for( unsigned int n = 0; n < lineLength; n++ )
+      {
+      for( unsigned int c = 0; c < numberTensorElements; c++ )
+        {
+        const double w = B * value[c] + b1 * w1[c] + b2 * w2[c] + b3 * w3[c];
+        value[c] = w;
+        w3[c] = w2[c];
+        w2[c] = w1[c];
+        w1[c] = w;
+        }
+      value -= numberTensorElements;
       }
-    
-    m_TensorComponentSmoothingFilter->SetInput(componentImage);
-    m_TensorComponentSmoothingFilter->Update();
-    
-    ImageRegionIteratorWithIndex< ComponentImageType > 
-    smoothedCompIt( m_TensorComponentSmoothingFilter->GetOutput(),
-                    m_TensorComponentSmoothingFilter->GetOutput()->GetRequestedRegion());
-    
-    ottensor.GoToBegin();
-    smoothedCompIt.GoToBegin();
-
-    while( !ottensor.IsAtEnd() )
+
+    it.GoToBeginOfLine();
+    value = &line[0];
+    while( !it.IsAtEndOfLine() )
       {
-      ottensor.Value()[i] = smoothedCompIt.Get();  
-      ++smoothedCompIt;
-      ++ottensor;
+      OutputPixelType & pixel = it.Value();
+      for( unsigned int c = 0; c < numberTensorElements; c++ )
+        {
+        pixel[c] = static_cast< OutputComponentType >( *value++ );
+        }
+      ++it;
       }
-    
+
+    it.NextLine();
     }
 }
 
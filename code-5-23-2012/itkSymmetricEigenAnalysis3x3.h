@@ -0,0 +1,153 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkSymmetricEigenAnalysis3x3_h
+#define __itkSymmetricEigenAnalysis3x3_h
+
+#include "itkMacro.h"
+
+namespace itk
+{
+
+/** \class SymmetricEigenAnalysis3x3
+ * \brief Closed-form eigen analysis of 3x3 real symmetric matrices.
+ *
+ * This class has the same interface as SymmetricEigenAnalysis but only
+ * handles 3x3 matrices. The eigen value that is best separated from the
+ * other two is a root of the characteristic polynomial, computed with the
+ * trigonometric method, and its eigen vector is computed from cross
+ * products of the rows of (A - lambda I). The two other eigen values and
+ * eigen vectors come from a Jacobi rotation of A restricted to the
+ * orthogonal complement of that vector. The roots of the polynomial lose
+ * half of their digits when two eigen values (nearly) coincide; the
+ * rotation does not, so all the eigen values are accurate to rounding and
+ * the eigen vectors stay orthonormal. ComputeEigenValues() therefore does
+ * about the same work as ComputeEigenValuesAndVectors().
+ *
+ * The matrix is scaled by its largest element before the analysis so the
+ * result does not overflow or underflow for tensors with very large or very
+ * small entries.
+ *
+ * Reference: D. Eberly, "A Robust Eigensolver for 3 x 3 Symmetric Matrices",
+ * Geometric Tools, 2014.
+ *
+ * TMatrix must provide the (row,col) operator, TVector the [] operator and
+ * TEigenMatrix the [][] operator. The eigen vectors are stored as the rows of
+ * the eigen vector matrix.
+ *
+ * \sa SymmetricEigenAnalysis
+ */
+template < typename TMatrix, typename TVector, typename TEigenMatrix=TMatrix >
+class SymmetricEigenAnalysis3x3
+{
+public:
+  typedef TMatrix      MatrixType;
+  typedef TEigenMatrix EigenMatrixType;
+  typedef TVector      VectorType;
+
+  SymmetricEigenAnalysis3x3() :
+      m_OrderEigenValues(true),
+      m_OrderEigenMagnitudes(false) {}
+
+  SymmetricEigenAnalysis3x3( const unsigned int dimension ) :
+      m_OrderEigenValues(true),
+      m_OrderEigenMagnitudes(false)
+    {
+    this->SetDimension( dimension );
+    }
+
+  ~SymmetricEigenAnalysis3x3() {}
+
+  /** Compute the eigen values of A. Returns 0 on success. */
+  unsigned int ComputeEigenValues( const TMatrix  & A,
+                                   TVector        & EigenValues ) const;
+
+  /** Compute the eigen values and the eigen vectors of A. The eigen vectors
+   * are returned as the rows of EigenVectors. Returns 0 on success. */
+  unsigned int ComputeEigenValuesAndVectors( const TMatrix  & A,
+                                             TVector        & EigenValues,
+                                             TEigenMatrix   & EigenVectors ) const;
+
+  /** Order eigen values by value, ascending. Default is true. */
+  void SetOrderEigenValues( const bool b )
+    {
+    if( b ) { m_OrderEigenMagnitudes = false; }
+    m_OrderEigenValues = b;
+    }
+  bool GetOrderEigenValues() const { return m_OrderEigenValues; }
+
+  /** Order eigen values by magnitude, ascending. Default is false. */
+  void SetOrderEigenMagnitudes( const bool b )
+    {
+    if( b ) { m_OrderEigenValues = false; }
+    m_OrderEigenMagnitudes = b;
+    }
+  bool GetOrderEigenMagnitudes() const { return m_OrderEigenMagnitudes; }
+
+  /** The dimension is fixed to 3. This method only exists for interface
+   * compatibility with SymmetricEigenAnalysis. */
+  void SetDimension( const unsigned int n )
+    {
+    if( n != 3 )
+      {
+      itkGenericExceptionMacro(
+        << "SymmetricEigenAnalysis3x3 only handles 3x3 matrices, not "
+        << n << "x" << n );
+      }
+    }
+  unsigned int GetDimension() const { return 3; }
+
+private:
+  /** Eigen values, ascending, and the matching eigen vectors of the
+   * symmetric matrix (a00 a01 a02; a01 a11 a12; a02 a12 a22). */
+  void Solve( double a00, double a01, double a02,
+              double a11, double a12, double a22,
+              double eval[3], double evec[3][3] ) const;
+
+  static void ComputeOrthogonalComplement( const double w[3],
+                                           double u[3], double v[3] );
+
+  static void ComputeEigenVector0( double a00, double a01, double a02,
+                                   double a11, double a12, double a22,
+                                   double eval, double evec[3] );
+
+  /** The two eigen values, ascending, and eigen vectors of A in the plane
+   * orthogonal to the eigen vector evec0 */
+  static void ComputeEigenPairs( double a00, double a01, double a02,
+                                 double a11, double a12, double a22,
+                                 const double evec0[3], double eval[2],
+                                 double evec[][3] );
+
+  /** Permutation that orders the eigen values as requested */
+  void ComputeOrder( const double eval[3], unsigned int order[3] ) const;
+
+  bool m_OrderEigenValues;
+  bool m_OrderEigenMagnitudes;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSymmetricEigenAnalysis3x3.txx"
+#endif
+
+#endif
@@ -0,0 +1,358 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkSymmetricEigenAnalysis3x3_txx
+#define __itkSymmetricEigenAnalysis3x3_txx
+
+#include "itkSymmetricEigenAnalysis3x3.h"
+#include "vnl/vnl_math.h"
+
+namespace itk
+{
+
+template< class TMatrix, class TVector, class TEigenMatrix >
+unsigned int
+SymmetricEigenAnalysis3x3< TMatrix, TVector, TEigenMatrix >
+::ComputeEigenValues( const TMatrix & A, TVector & D ) const
+{
+  double eval[3];
+  double evec[3][3];
+
+  this->Solve( A(0,0), A(0,1), A(0,2), A(1,1), A(1,2), A(2,2),
+               eval, evec );
+
+  unsigned int order[3];
+  this->ComputeOrder( eval, order );
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    D[i] = eval[ order[i] ];
+    }
+  return 0;
+}
+
+template< class TMatrix, class TVector, class TEigenMatrix >
+unsigned int
+SymmetricEigenAnalysis3x3< TMatrix, TVector, TEigenMatrix >
+::ComputeEigenValuesAndVectors( const TMatrix & A,
+                                TVector & EigenValues,
+                                TEigenMatrix & EigenVectors ) const
+{
+  double eval[3];
+  double evec[3][3];
+
+  this->Solve( A(0,0), A(0,1), A(0,2), A(1,1), A(1,2), A(2,2),
+               eval, evec );
+
+  unsigned int order[3];
+  this->ComputeOrder( eval, order );
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    EigenValues[i] = eval[ order[i] ];
+    for( unsigned int j = 0; j < 3; j++ )
+      {
+      EigenVectors[i][j] = evec[ order[i] ][j];
+      }
+    }
+  return 0;
+}
+
+template< class TMatrix, class TVector, class TEigenMatrix >
+void
+SymmetricEigenAnalysis3x3< TMatrix, TVector, TEigenMatrix >
+::Solve( double a00, double a01, double a02,
+         double a11, double a12, double a22,
+         double eval[3], double evec[3][3] ) const
+{
+  // Scale the matrix so its largest element is one in magnitude.
+  double maxAbs = vnl_math_abs( a00 );
+  maxAbs = vnl_math_max( maxAbs, vnl_math_abs( a01 ) );
+  maxAbs = vnl_math_max( maxAbs, vnl_math_abs( a02 ) );
+  maxAbs = vnl_math_max( maxAbs, vnl_math_abs( a11 ) );
+  maxAbs = vnl_math_max( maxAbs, vnl_math_abs( a12 ) );
+  maxAbs = vnl_math_max( maxAbs, vnl_math_abs( a22 ) );
+
+  if( maxAbs == 0.0 )
+    {
+    // Zero matrix
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      eval[i] = 0.0;
+      evec[i][0] = evec[i][1] = evec[i][2] = 0.0;
+      evec[i][i] = 1.0;
+      }
+    return;
+    }
+
+  const double invMaxAbs = 1.0 / maxAbs;
+  a00 *= invMaxAbs;
+  a01 *= invMaxAbs;
+  a02 *= invMaxAbs;
+  a11 *= invMaxAbs;
+  a12 *= invMaxAbs;
+  a22 *= invMaxAbs;
+
+  const double norm = a01 * a01 + a02 * a02 + a12 * a12;
+  if( norm <= 0.0 )
+    {
+    // The matrix is diagonal
+    eval[0] = a00 * maxAbs;
+    eval[1] = a11 * maxAbs;
+    eval[2] = a22 * maxAbs;
+    for( unsigned int i = 0; i < 3; i++ )
+      {
+      evec[i][0] = evec[i][1] = evec[i][2] = 0.0;
+      evec[i][i] = 1.0;
+      }
+    return;
+    }
+
+  // Eigen values of B = (A - q I) / p are 2 cos( angle + 2 pi k / 3 ),
+  // where det(B) / 2 = cos( 3 angle ).
+  const double q = ( a00 + a11 + a22 ) / 3.0;
+  const double b00 = a00 - q;
+  const double b11 = a11 - q;
+  const double b22 = a22 - q;
+  const double p = vcl_sqrt( ( b00 * b00 + b11 * b11 + b22 * b22
+                               + 2.0 * norm ) / 6.0 );
+
+  const double c00 = b11 * b22 - a12 * a12;
+  const double c01 = a01 * b22 - a12 * a02;
+  const double c02 = a01 * a12 - b11 * a02;
+  const double det = ( b00 * c00 - a01 * c01 + a02 * c02 ) / ( p * p * p );
+
+  double halfDet = 0.5 * det;
+  halfDet = vnl_math_min( vnl_math_max( halfDet, -1.0 ), 1.0 );
+
+  // Only the eigen value that is best separated from the others is taken
+  // from the trigonometric method: near a double root the angle, and with
+  // it the two close eigen values, lose half of their digits. halfDet >= 0
+  // means the largest eigen value, 2 cos( angle ), is the best separated,
+  // otherwise the smallest one, 2 cos( angle + 2 pi / 3 ).
+  const double twoThirdsPi = 2.09439510239319549;
+  const double angle = vcl_acos( halfDet ) / 3.0;
+  const unsigned int separated = ( halfDet >= 0.0 ) ? 2 : 0;
+  const unsigned int first = ( halfDet >= 0.0 ) ? 0 : 1;
+  const double beta = ( halfDet >= 0.0 ) ? vcl_cos( angle ) * 2.0
+                                          : vcl_cos( angle + twoThirdsPi ) * 2.0;
+  const double separatedEval = q + p * beta;
+  ComputeEigenVector0( a00, a01, a02, a11, a12, a22, separatedEval,
+                       evec[separated] );
+
+  // The two other eigen values and their eigen vectors diagonalise the
+  // restriction of A to the orthogonal complement of that eigen vector
+  double pairEval[2];
+  ComputeEigenPairs( a00, a01, a02, a11, a12, a22, evec[separated],
+                     pairEval, evec + first );
+  eval[first] = pairEval[0];
+  eval[first+1] = pairEval[1];
+
+  // Rayleigh quotient of the separated eigen vector
+  const double * w = evec[separated];
+  eval[separated] =
+    w[0] * ( a00 * w[0] + a01 * w[1] + a02 * w[2] )
+    + w[1] * ( a01 * w[0] + a11 * w[1] + a12 * w[2] )
+    + w[2] * ( a02 * w[0] + a12 * w[1] + a22 * w[2] );
+
+  // Undo the scaling
+  eval[0] *= maxAbs;
+  eval[1] *= maxAbs;
+  eval[2] *= maxAbs;
+}
+
+template< class TMatrix, class TVector, class TEigenMatrix >
+void
+SymmetricEigenAnalysis3x3< TMatrix, TVector, TEigenMatrix >
+::ComputeOrthogonalComplement( const double w[3], double u[3], double v[3] )
+{
+  // Pick the larger of the two candidates to avoid dividing by a small
+  // number. w is a unit vector.
+  if( vnl_math_abs( w[0] ) > vnl_math_abs( w[1] ) )
+    {
+    const double invLength = 1.0 / vcl_sqrt( w[0] * w[0] + w[2] * w[2] );
+    u[0] = -w[2] * invLength;
+    u[1] = 0.0;
+    u[2] = w[0] * invLength;
+    }
+  else
+    {
+    const double invLength = 1.0 / vcl_sqrt( w[1] * w[1] + w[2] * w[2] );
+    u[0] = 0.0;
+    u[1] = w[2] * invLength;
+    u[2] = -w[1] * invLength;
+    }
+  v[0] = w[1] * u[2] - w[2] * u[1];
+  v[1] = w[2] * u[0] - w[0] * u[2];
+  v[2] = w[0] * u[1] - w[1] * u[0];
+}
+
+template< class TMatrix, class TVector, class TEigenMatrix >
+void
+SymmetricEigenAnalysis3x3< TMatrix, TVector, TEigenMatrix >
+::ComputeEigenVector0( double a00, double a01, double a02,
+                       double a11, double a12, double a22,
+                       double eval, double evec[3] )
+{
+  // The eigen vector is orthogonal to the rows of (A - eval I). Use the
+  // cross product of the two rows that are the furthest from parallel.
+  const double r0[3] = { a00 - eval, a01, a02 };
+  const double r1[3] = { a01, a11 - eval, a12 };
+  const double r2[3] = { a02, a12, a22 - eval };
+
+  const double r0xr1[3] = { r0[1] * r1[2] - r0[2] * r1[1],
+                            r0[2] * r1[0] - r0[0] * r1[2],
+                            r0[0] * r1[1] - r0[1] * r1[0] };
+  const double r0xr2[3] = { r0[1] * r2[2] - r0[2] * r2[1],
+                            r0[2] * r2[0] - r0[0] * r2[2],
+                            r0[0] * r2[1] - r0[1] * r2[0] };
+  const double r1xr2[3] = { r1[1] * r2[2] - r1[2] * r2[1],
+                            r1[2] * r2[0] - r1[0] * r2[2],
+                            r1[0] * r2[1] - r1[1] * r2[0] };
+
+  const double d0 = r0xr1[0] * r0xr1[0] + r0xr1[1] * r0xr1[1]
+                    + r0xr1[2] * r0xr1[2];
+  const double d1 = r0xr2[0] * r0xr2[0] + r0xr2[1] * r0xr2[1]
+                    + r0xr2[2] * r0xr2[2];
+  const double d2 = r1xr2[0] * r1xr2[0] + r1xr2[1] * r1xr2[1]
+                    + r1xr2[2] * r1xr2[2];
+
+  const double * best = r0xr1;
+  double dmax = d0;
+  if( d1 > dmax )
+    {
+    best = r0xr2;
+    dmax = d1;
+    }
+  if( d2 > dmax )
+    {
+    best = r1xr2;
+    dmax = d2;
+    }
+
+  if( dmax > 0.0 )
+    {
+    const double invLength = 1.0 / vcl_sqrt( dmax );
+    evec[0] = best[0] * invLength;
+    evec[1] = best[1] * invLength;
+    evec[2] = best[2] * invLength;
+    }
+  else
+    {
+    // A is a multiple of the identity; any vector is an eigen vector.
+    evec[0] = 1.0;
+    evec[1] = 0.0;
+    evec[2] = 0.0;
+    }
+}
+
+template< class TMatrix, class TVector, class TEigenMatrix >
+void
+SymmetricEigenAnalysis3x3< TMatrix, TVector, TEigenMatrix >
+::ComputeEigenPairs( double a00, double a01, double a02,
+                     double a11, double a12, double a22,
+                     const double evec0[3], double eval[2],
+                     double evec[][3] )
+{
+  // Restrict A to the plane orthogonal to evec0
+  double u[3];
+  double v[3];
+  ComputeOrthogonalComplement( evec0, u, v );
+
+  const double au[3] = { a00 * u[0] + a01 * u[1] + a02 * u[2],
+                         a01 * u[0] + a11 * u[1] + a12 * u[2],
+                         a02 * u[0] + a12 * u[1] + a22 * u[2] };
+  const double av[3] = { a00 * v[0] + a01 * v[1] + a02 * v[2],
+                         a01 * v[0] + a11 * v[1] + a12 * v[2],
+                         a02 * v[0] + a12 * v[1] + a22 * v[2] };
+
+  const double m00 = u[0] * au[0] + u[1] * au[1] + u[2] * au[2];
+  const double m01 = u[0] * av[0] + u[1] * av[1] + u[2] * av[2];
+  const double m11 = v[0] * av[0] + v[1] * av[1] + v[2] * av[2];
+
+  // One Jacobi rotation diagonalises the 2x2 restriction. t is the smaller
+  // root of t^2 + 2 theta t - 1 = 0, computed without overflow.
+  double t = 0.0;
+  if( m01 != 0.0 )
+    {
+    const double theta = ( m11 - m00 ) / ( 2.0 * m01 );
+    if( vnl_math_abs( theta ) > 1.0 )
+      {
+      t = 1.0 / ( theta * ( 1.0 + vcl_sqrt( 1.0 + 1.0 / ( theta * theta ) ) ) );
+      }
+    else
+      {
+      t = ( ( theta >= 0.0 ) ? 1.0 : -1.0 )
+        / ( vnl_math_abs( theta ) + vcl_sqrt( theta * theta + 1.0 ) );
+      }
+    }
+  const double c = 1.0 / vcl_sqrt( t * t + 1.0 );
+  const double s = t * c;
+
+  // Eigen value of c u - s v and of s u + c v
+  const double e0 = m00 - t * m01;
+  const double e1 = m11 + t * m01;
+
+  const unsigned int lower = ( e0 <= e1 ) ? 0 : 1;
+  eval[lower] = e0;
+  eval[1-lower] = e1;
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    evec[lower][i] = c * u[i] - s * v[i];
+    evec[1-lower][i] = s * u[i] + c * v[i];
+    }
+}
+
+template< class TMatrix, class TVector, class TEigenMatrix >
+void
+SymmetricEigenAnalysis3x3< TMatrix, TVector, TEigenMatrix >
+::ComputeOrder( const double eval[3], unsigned int order[3] ) const
+{
+  order[0] = 0;
+  order[1] = 1;
+  order[2] = 2;
+
+  if( !m_OrderEigenValues && !m_OrderEigenMagnitudes )
+    {
+    return;
+    }
+
+  // Insertion sort of three elements
+  double key[3];
+  for( unsigned int i = 0; i < 3; i++ )
+    {
+    key[i] = m_OrderEigenMagnitudes ? vnl_math_abs( eval[i] ) : eval[i];
+    }
+  for( unsigned int i = 1; i < 3; i++ )
+    {
+    unsigned int j = i;
+    while( j > 0 && key[ order[j] ] < key[ order[j-1] ] )
+      {
+      const unsigned int tmp = order[j];
+      order[j] = order[j-1];
+      order[j-1] = tmp;
+      --j;
+      }
+    }
+}
+
+} // end namespace itk
+
+#endif
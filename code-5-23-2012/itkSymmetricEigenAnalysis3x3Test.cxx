@@ -0,0 +1,323 @@
+/*=========================================================================
+
+  Program:   Insight Segmentation & Registration Toolkit
+  Module:    $RCSfile: itkSymmetricEigenAnalysis3x3Test.cxx,v $
+  Language:  C++
+
+  Copyright (c) Insight Software Consortium. All rights reserved.
+  See ITKCopyright.txt or http://www.itk.org/HTML/Copyright.htm for details.
+
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notices for more information.
+
+=========================================================================*/
+#if defined(_MSC_VER)
+#pragma warning ( disable : 4786 )
+#endif
+
+// Compares the closed-form solver SymmetricEigenAnalysis3x3 with the QL
+// method of SymmetricEigenAnalysis on random symmetric matrices and on the
+// cases that are hard for a closed form: two or three equal eigen values,
+// nearly equal eigen values, diagonal and zero matrices and very large or
+// very small entries. For every matrix the eigen values must be ordered,
+// match the QL method, and the eigen vectors must satisfy A v = lambda v
+// and be orthonormal, all within Tolerance relative to the largest entry.
+
+#include "itkSymmetricEigenAnalysis3x3.h"
+#include "itkSymmetricEigenAnalysis.h"
+#include "itkSymmetricSecondRankTensor.h"
+#include "itkFixedArray.h"
+#include "itkMatrix.h"
+#include "itkMersenneTwisterRandomVariateGenerator.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+typedef itk::SymmetricSecondRankTensor< double, 3 >  MatrixType;
+typedef itk::FixedArray< double, 3 >                 EigenValuesType;
+typedef itk::Matrix< double, 3, 3 >                  EigenVectorsType;
+
+typedef itk::SymmetricEigenAnalysis< MatrixType, EigenValuesType,
+                                     EigenVectorsType >    QLSolverType;
+typedef itk::SymmetricEigenAnalysis3x3< MatrixType, EigenValuesType,
+                                        EigenVectorsType > ClosedFormSolverType;
+
+typedef itk::Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+
+const double Tolerance = 1e-12;
+
+// Q diag( values ) Q^T for a random rotation Q, made from a random unit
+// quaternion
+MatrixType ComposeMatrix( const double values[3], GeneratorType * generator )
+{
+  double q[4];
+  double norm = 0.0;
+  for ( unsigned int i = 0; i < 4; i++ )
+    {
+    q[i] = generator->GetNormalVariate();
+    norm += q[i] * q[i];
+    }
+  norm = vcl_sqrt( norm );
+  const double w = q[0] / norm;
+  const double x = q[1] / norm;
+  const double y = q[2] / norm;
+  const double z = q[3] / norm;
+
+  const double rotation[3][3] = {
+    { 1 - 2 * ( y * y + z * z ), 2 * ( x * y - w * z ), 2 * ( x * z + w * y ) },
+    { 2 * ( x * y + w * z ), 1 - 2 * ( x * x + z * z ), 2 * ( y * z - w * x ) },
+    { 2 * ( x * z - w * y ), 2 * ( y * z + w * x ), 1 - 2 * ( x * x + y * y ) } };
+
+  MatrixType matrix;
+  for ( unsigned int r = 0; r < 3; r++ )
+    {
+    for ( unsigned int c = r; c < 3; c++ )
+      {
+      double sum = 0.0;
+      for ( unsigned int k = 0; k < 3; k++ )
+        {
+        sum += rotation[r][k] * values[k] * rotation[c][k];
+        }
+      matrix( r, c ) = sum;
+      }
+    }
+  return matrix;
+}
+
+// Symmetric matrix with random entries in [-1, 1]
+MatrixType RandomMatrix( GeneratorType * generator )
+{
+  MatrixType matrix;
+  for ( unsigned int r = 0; r < 3; r++ )
+    {
+    for ( unsigned int c = r; c < 3; c++ )
+      {
+      matrix( r, c ) = 2.0 * generator->GetVariateWithClosedRange() - 1.0;
+      }
+    }
+  return matrix;
+}
+
+// Eigen values sorted by value, whatever order the solver used
+void SortEigenValues( const EigenValuesType & values, double sorted[3] )
+{
+  for ( unsigned int i = 0; i < 3; i++ )
+    {
+    sorted[i] = values[i];
+    }
+  std::sort( sorted, sorted + 3 );
+}
+
+bool CheckMatrix( const char * name, const MatrixType & matrix,
+                  bool orderEigenMagnitudes )
+{
+  double scale = 0.0;
+  for ( unsigned int r = 0; r < 3; r++ )
+    {
+    for ( unsigned int c = 0; c < 3; c++ )
+      {
+      scale = vnl_math_max( scale, vnl_math_abs( matrix( r, c ) ) );
+      }
+    }
+  const double tolerance = Tolerance * ( scale > 0.0 ? scale : 1.0 );
+
+  QLSolverType qlSolver( 3 );
+  ClosedFormSolverType closedFormSolver( 3 );
+  if ( orderEigenMagnitudes )
+    {
+    qlSolver.SetOrderEigenMagnitudes( true );
+    closedFormSolver.SetOrderEigenMagnitudes( true );
+    }
+
+  EigenValuesType  values;
+  EigenVectorsType vectors;
+  EigenValuesType  valuesOnly;
+  EigenValuesType  qlValues;
+  if ( closedFormSolver.ComputeEigenValuesAndVectors( matrix, values, vectors ) != 0
+       || closedFormSolver.ComputeEigenValues( matrix, valuesOnly ) != 0 )
+    {
+    std::cerr << name << ": the closed-form solver failed on "
+              << matrix << std::endl;
+    return false;
+    }
+  qlSolver.ComputeEigenValues( matrix, qlValues );
+
+  bool ok = true;
+
+  // Ordered by value or by magnitude
+  for ( unsigned int i = 0; i + 1 < 3; i++ )
+    {
+    const double key     = orderEigenMagnitudes ? vnl_math_abs( values[i] )
+                                                : values[i];
+    const double nextKey = orderEigenMagnitudes ? vnl_math_abs( values[i+1] )
+                                                : values[i+1];
+    if ( key > nextKey + tolerance )
+      {
+      std::cerr << name << ": the eigen values " << values
+                << " are not in order" << std::endl;
+      ok = false;
+      }
+    }
+
+  // Same eigen values as the QL method, with or without the eigen vectors.
+  // Eigen values of equal magnitude may come in either order, so they are
+  // compared sorted by value.
+  double sorted[3];
+  double sortedOnly[3];
+  double sortedQL[3];
+  SortEigenValues( values, sorted );
+  SortEigenValues( valuesOnly, sortedOnly );
+  SortEigenValues( qlValues, sortedQL );
+  for ( unsigned int i = 0; i < 3; i++ )
+    {
+    if ( vnl_math_abs( sorted[i] - sortedQL[i] ) > tolerance
+         || vnl_math_abs( sortedOnly[i] - sorted[i] ) > tolerance )
+      {
+      std::cerr << name << ": the eigen values " << values << " and "
+                << valuesOnly << " differ from the QL method " << qlValues
+                << std::endl;
+      ok = false;
+      break;
+      }
+    }
+
+  // A v = lambda v for each eigen vector, stored as a row
+  for ( unsigned int i = 0; i < 3; i++ )
+    {
+    double residual = 0.0;
+    for ( unsigned int r = 0; r < 3; r++ )
+      {
+      double product = 0.0;
+      for ( unsigned int c = 0; c < 3; c++ )
+        {
+        product += matrix( r, c ) * vectors[i][c];
+        }
+      const double difference = product - values[i] * vectors[i][r];
+      residual += difference * difference;
+      }
+    if ( vcl_sqrt( residual ) > tolerance )
+      {
+      std::cerr << name << ": A v - lambda v is " << vcl_sqrt( residual )
+                << " for eigen value " << values[i] << std::endl;
+      ok = false;
+      }
+    }
+
+  // Orthonormal eigen vectors
+  for ( unsigned int i = 0; i < 3; i++ )
+    {
+    for ( unsigned int j = i; j < 3; j++ )
+      {
+      double dot = 0.0;
+      for ( unsigned int k = 0; k < 3; k++ )
+        {
+        dot += vectors[i][k] * vectors[j][k];
+        }
+      const double expected = ( i == j ) ? 1.0 : 0.0;
+      if ( vnl_math_abs( dot - expected ) > Tolerance )
+        {
+        std::cerr << name << ": the eigen vectors " << i << " and " << j
+                  << " have a dot product of " << dot << std::endl;
+        ok = false;
+        }
+      }
+    }
+
+  if ( !ok )
+    {
+    std::cerr << name << ": matrix " << matrix << std::endl;
+    }
+  return ok;
+}
+
+// Check the matrix with both orders
+bool Check( const char * name, const MatrixType & matrix )
+{
+  const bool byValue = CheckMatrix( name, matrix, false );
+  const bool byMagnitude = CheckMatrix( name, matrix, true );
+  return byValue && byMagnitude;
+}
+}
+
+int main(int, char* [] )
+{
+  GeneratorType::Pointer generator = GeneratorType::New();
+  generator->Initialize( 20120523 );
+
+  const unsigned int numberOfRandomMatrices = 1000;
+  unsigned int numberOfFailures = 0;
+
+  // Random symmetric positive definite matrices, also scaled to very large
+  // and very small entries
+  for ( unsigned int m = 0; m < numberOfRandomMatrices; m++ )
+    {
+    double values[3];
+    for ( unsigned int i = 0; i < 3; i++ )
+      {
+      values[i] = 0.01 + generator->GetVariateWithClosedRange();
+      }
+    const MatrixType matrix = ComposeMatrix( values, generator );
+    numberOfFailures += !Check( "random SPD", matrix );
+    numberOfFailures += !Check( "random SPD * 1e150", matrix * 1e150 );
+    numberOfFailures += !Check( "random SPD * 1e-150", matrix * 1e-150 );
+    }
+
+  // Random symmetric matrices, indefinite in general
+  for ( unsigned int m = 0; m < numberOfRandomMatrices; m++ )
+    {
+    numberOfFailures += !Check( "random symmetric", RandomMatrix( generator ) );
+    }
+
+  // Two equal eigen values, the double one the smallest or the largest
+  for ( unsigned int m = 0; m < numberOfRandomMatrices; m++ )
+    {
+    const double doubleSmallest[3] = { 1.0, 1.0, 3.0 };
+    const double doubleLargest[3] = { -2.0, 0.5, 0.5 };
+    numberOfFailures += !Check( "two equal, smallest",
+      ComposeMatrix( doubleSmallest, generator ) );
+    numberOfFailures += !Check( "two equal, largest",
+      ComposeMatrix( doubleLargest, generator ) );
+    }
+
+  // Nearly equal eigen values
+  for ( unsigned int m = 0; m < numberOfRandomMatrices; m++ )
+    {
+    const double nearlyEqual[3] = { 1.0, 1.0 + 1e-9, 2.0 };
+    const double nearlyTriple[3] = { 1.0 - 1e-12, 1.0, 1.0 + 1e-12 };
+    numberOfFailures += !Check( "nearly equal",
+      ComposeMatrix( nearlyEqual, generator ) );
+    numberOfFailures += !Check( "nearly triple",
+      ComposeMatrix( nearlyTriple, generator ) );
+    }
+
+  // Three equal eigen values
+  MatrixType matrix;
+  matrix.Fill( 0.0 );
+  matrix( 0, 0 ) = 2.5;
+  matrix( 1, 1 ) = 2.5;
+  matrix( 2, 2 ) = 2.5;
+  numberOfFailures += !Check( "three equal", matrix );
+
+  // Diagonal, with a negative eigen value
+  matrix( 0, 0 ) = 3.0;
+  matrix( 1, 1 ) = -1.0;
+  matrix( 2, 2 ) = 2.0;
+  numberOfFailures += !Check( "diagonal", matrix );
+
+  // Zero
+  matrix.Fill( 0.0 );
+  numberOfFailures += !Check( "zero", matrix );
+
+  if ( numberOfFailures > 0 )
+    {
+    std::cerr << numberOfFailures << " matrices failed" << std::endl;
+    return EXIT_FAILURE;
+    }
+
+  std::cout << "Test passed." << std::endl;
+  return EXIT_SUCCESS;
+}
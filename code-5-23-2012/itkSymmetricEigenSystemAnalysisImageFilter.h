@@ -0,0 +1,181 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkSymmetricEigenSystemAnalysisImageFilter_h
+#define __itkSymmetricEigenSystemAnalysisImageFilter_h
+
+#include "itkImageToImageFilter.h"
+#include "itkSymmetricEigenAnalysis.h"
+#include "itkSymmetricEigenAnalysis3x3.h"
+
+namespace itk
+{
+
+/** \class SymmetricEigenSystemAnalysisImageFilter
+ *
+ * \brief Computes the eigen values and the eigen vectors of a symmetric
+ *        tensor image in a single pass.
+ *
+ * SymmetricEigenAnalysisImageFilter and SymmetricEigenVectorAnalysisImageFilter
+ * each solve the same eigen system for every pixel and keep only half of
+ * the result. This filter solves it once per pixel and writes both halves:
+ * the eigen values are the first output and the eigen vectors (stored as the
+ * rows of a matrix) are the second output.
+ *
+ * The input pixel type must provide the API for the [][] operator, the eigen
+ * value pixel type the [] operator and the eigen vector pixel type the
+ * [][] operator. Input pixel matrices should be symmetric.
+ *
+ * By default the eigen system is solved with the iterative QL method of
+ * SymmetricEigenAnalysis. For 3x3 tensors the closed-form solver of
+ * SymmetricEigenAnalysis3x3 can be selected with UseClosedFormSolverOn().
+ *
+ * \sa SymmetricEigenAnalysisImageFilter
+ * \sa SymmetricEigenVectorAnalysisImageFilter
+ * \sa SymmetricEigenAnalysis3x3
+ *
+ * \ingroup IntensityImageFilters  Multithreaded  TensorObjects
+ */
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+class ITK_EXPORT SymmetricEigenSystemAnalysisImageFilter :
+    public ImageToImageFilter<TInputImage, TEigenValueImage>
+{
+public:
+  /** Standard class typedefs. */
+  typedef SymmetricEigenSystemAnalysisImageFilter          Self;
+  typedef ImageToImageFilter<TInputImage, TEigenValueImage> Superclass;
+  typedef SmartPointer<Self>                               Pointer;
+  typedef SmartPointer<const Self>                         ConstPointer;
+
+  /** Method for creation through the object factory. */
+  itkNewMacro(Self);
+
+  /** Run-time type information (and related methods) */
+  itkTypeMacro(SymmetricEigenSystemAnalysisImageFilter, ImageToImageFilter);
+
+  /** Image typedefs */
+  typedef TInputImage                                  InputImageType;
+  typedef TEigenValueImage                             EigenValueImageType;
+  typedef TEigenVectorImage                            EigenVectorImageType;
+  typedef typename InputImageType::PixelType           InputPixelType;
+  typedef typename EigenValueImageType::PixelType      EigenValueArrayType;
+  typedef typename EigenVectorImageType::PixelType     EigenVectorMatrixType;
+  typedef typename Superclass::OutputImageRegionType   OutputImageRegionType;
+
+  typedef SymmetricEigenAnalysis< InputPixelType, EigenValueArrayType,
+                                  EigenVectorMatrixType > CalculatorType;
+  typedef SymmetricEigenAnalysis3x3< InputPixelType, EigenValueArrayType,
+                                     EigenVectorMatrixType > Calculator3x3Type;
+
+  /** Typdedefs to order eigen values.
+   * OrderByValue:      lambda_1 < lambda_2 < ....
+   * OrderByMagnitude:  |lambda_1| < |lambda_2| < .....
+   * DoNotOrder:        Default order of eigen values obtained after QL method
+   */
+  typedef enum {
+    OrderByValue=1,
+    OrderByMagnitude,
+    DoNotOrder
+  }EigenValueOrderType;
+
+  /** Order eigen values. Default is to OrderByValue:  lambda_1 < lambda_2 < ....*/
+  void OrderEigenValuesBy( EigenValueOrderType order )
+    {
+    if( order == OrderByMagnitude )
+      {
+      m_Calculator.SetOrderEigenMagnitudes( true );
+      m_Calculator3x3.SetOrderEigenMagnitudes( true );
+      }
+    else if( order == DoNotOrder )
+      {
+      m_Calculator.SetOrderEigenValues( false );
+      m_Calculator3x3.SetOrderEigenValues( false );
+      }
+    this->Modified();
+    }
+
+  /** Set the dimension of the tensor. (For example the SymmetricSecondRankTensor
+   * is a pxp matrix) */
+  void SetDimension( unsigned int p )
+    {
+    m_Calculator.SetDimension(p);
+    this->Modified();
+    }
+
+  /** Use the closed-form 3x3 solver instead of the iterative QL method.
+   * The dimension must be 3. Default is off. */
+  itkSetMacro( UseClosedFormSolver, bool );
+  itkGetConstMacro( UseClosedFormSolver, bool );
+  itkBooleanMacro( UseClosedFormSolver );
+
+  /** Get the eigen value image (first output). */
+  EigenValueImageType * GetEigenValueImage()
+    {
+    return this->GetOutput();
+    }
+
+  /** Get the eigen vector image (second output). The eigen vectors are the
+   * rows of the matrix pixels. */
+  EigenVectorImageType * GetEigenVectorImage();
+
+protected:
+  SymmetricEigenSystemAnalysisImageFilter();
+  virtual ~SymmetricEigenSystemAnalysisImageFilter() {};
+  void PrintSelf(std::ostream& os, Indent indent) const;
+
+  /** Create the eigen value and the eigen vector outputs */
+  virtual DataObject::Pointer MakeOutput(unsigned int idx);
+
+  /** The superclass only allocates outputs of the eigen value image type,
+   * so allocate the eigen vector image here. */
+  virtual void AllocateOutputs();
+
+  /** Check that the closed-form solver is only used for 3x3 tensors */
+  void BeforeThreadedGenerateData();
+
+  /** Solve the eigen system of every pixel of the region */
+  void ThreadedGenerateData( const OutputImageRegionType &outputRegionForThread,
+                             int threadId );
+
+private:
+  SymmetricEigenSystemAnalysisImageFilter(const Self&); //purposely not implemented
+  void operator=(const Self&); //purposely not implemented
+
+  /** Loop over the region with the given calculator */
+  template< class TCalculator >
+  void ComputeEigenSystem( const TCalculator & calculator,
+                           const OutputImageRegionType &outputRegionForThread,
+                           int threadId );
+
+  CalculatorType    m_Calculator;
+  Calculator3x3Type m_Calculator3x3;
+  bool              m_UseClosedFormSolver;
+};
+
+} // end namespace itk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "itkSymmetricEigenSystemAnalysisImageFilter.txx"
+#endif
+
+#endif
@@ -0,0 +1,183 @@
+/*=========================================================================
+
+Library:   TubeTK
+
+Copyright 2010 Kitware Inc. 28 Corporate Drive,
+Clifton Park, NY, 12065, USA.
+
+All rights reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+
+=========================================================================*/
+#ifndef __itkSymmetricEigenSystemAnalysisImageFilter_txx
+#define __itkSymmetricEigenSystemAnalysisImageFilter_txx
+
+#include "itkSymmetricEigenSystemAnalysisImageFilter.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkImageRegionIterator.h"
+#include "itkProgressReporter.h"
+
+namespace itk
+{
+
+/**
+ * Constructor
+ */
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::SymmetricEigenSystemAnalysisImageFilter()
+{
+  m_UseClosedFormSolver = false;
+
+  this->SetNumberOfRequiredOutputs( 2 );
+  this->SetNthOutput( 1, this->MakeOutput( 1 ) );
+}
+
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+DataObject::Pointer
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::MakeOutput(unsigned int idx)
+{
+  if( idx == 1 )
+    {
+    return static_cast<DataObject*>( EigenVectorImageType::New().GetPointer() );
+    }
+  return static_cast<DataObject*>( EigenValueImageType::New().GetPointer() );
+}
+
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+typename SymmetricEigenSystemAnalysisImageFilter<TInputImage,
+                                                 TEigenValueImage,
+                                                 TEigenVectorImage>
+::EigenVectorImageType *
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::GetEigenVectorImage()
+{
+  return dynamic_cast< EigenVectorImageType * >(
+    this->ProcessObject::GetOutput( 1 ) );
+}
+
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+void
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::AllocateOutputs()
+{
+  Superclass::AllocateOutputs();
+
+  EigenVectorImageType * eigenVectorImage = this->GetEigenVectorImage();
+  eigenVectorImage->SetBufferedRegion(
+    eigenVectorImage->GetRequestedRegion() );
+  eigenVectorImage->Allocate();
+}
+
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+void
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::BeforeThreadedGenerateData()
+{
+  if( m_UseClosedFormSolver && m_Calculator.GetDimension() != 3 )
+    {
+    itkExceptionMacro( << "The closed-form solver only handles 3x3 tensors, "
+                       << "but the dimension is set to "
+                       << m_Calculator.GetDimension() );
+    }
+}
+
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+void
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::ThreadedGenerateData( const OutputImageRegionType &outputRegionForThread,
+                        int threadId )
+{
+  if( m_UseClosedFormSolver )
+    {
+    this->ComputeEigenSystem( m_Calculator3x3, outputRegionForThread,
+                              threadId );
+    }
+  else
+    {
+    this->ComputeEigenSystem( m_Calculator, outputRegionForThread,
+                              threadId );
+    }
+}
+
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+template< class TCalculator >
+void
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::ComputeEigenSystem( const TCalculator & calculator,
+                      const OutputImageRegionType &outputRegionForThread,
+                      int threadId )
+{
+  ImageRegionConstIterator< InputImageType >
+    inputIt( this->GetInput(), outputRegionForThread );
+  ImageRegionIterator< EigenValueImageType >
+    eigenValueIt( this->GetEigenValueImage(), outputRegionForThread );
+  ImageRegionIterator< EigenVectorImageType >
+    eigenVectorIt( this->GetEigenVectorImage(), outputRegionForThread );
+
+  ProgressReporter progress( this, threadId,
+                             outputRegionForThread.GetNumberOfPixels() );
+
+  EigenValueArrayType   eigenValues;
+  EigenVectorMatrixType eigenVectorMatrix;
+
+  inputIt.GoToBegin();
+  eigenValueIt.GoToBegin();
+  eigenVectorIt.GoToBegin();
+  while( !inputIt.IsAtEnd() )
+    {
+    calculator.ComputeEigenValuesAndVectors( inputIt.Get(),
+                                             eigenValues,
+                                             eigenVectorMatrix );
+    eigenValueIt.Set( eigenValues );
+    eigenVectorIt.Set( eigenVectorMatrix );
+
+    ++inputIt;
+    ++eigenValueIt;
+    ++eigenVectorIt;
+    progress.CompletedPixel();
+    }
+}
+
+template <typename TInputImage, typename TEigenValueImage,
+          typename TEigenVectorImage>
+void
+SymmetricEigenSystemAnalysisImageFilter<TInputImage, TEigenValueImage,
+                                        TEigenVectorImage>
+::PrintSelf(std::ostream& os, Indent indent) const
+{
+  Superclass::PrintSelf(os, indent);
+  os << indent << "Dimension: " << m_Calculator.GetDimension() << std::endl;
+  os << indent << "UseClosedFormSolver: " << m_UseClosedFormSolver
+     << std::endl;
+}
+
+} // end namespace itk
+
+#endif
@@ -25,6 +25,7 @@ limitations under the License.
 
 #include "itkUnaryFunctorImageFilter.h"
 #include "itkSymmetricEigenAnalysis.h"
+#include "itkSymmetricEigenAnalysis3x3.h"
 
 
 namespace itk
@@ -38,15 +39,20 @@ namespace itk
 // The default operation is to order eigen values in ascending order.
 // You may also use OrderEigenValuesBy( ) to order eigen values by
 // magnitude as is common with use of tensors in vessel extraction.
+//
+// For 3x3 matrices, SetUseClosedFormSolver( true ) replaces the iterative
+// QL method with the closed-form solver of SymmetricEigenAnalysis3x3.
 namespace Functor {  
  
 template< typename TInput, typename TOutput, typename TMatrix >
 class SymmetricEigenVectorAnalysisFunction
 {
 public:
-  SymmetricEigenVectorAnalysisFunction() {}
+  SymmetricEigenVectorAnalysisFunction() : m_UseClosedFormSolver(false) {}
   ~SymmetricEigenVectorAnalysisFunction() {}
   typedef SymmetricEigenAnalysis< TInput, TOutput, TMatrix > CalculatorType;
+  typedef SymmetricEigenAnalysis3x3< TInput, TOutput, TMatrix >
+                                                            Calculator3x3Type;
   bool operator!=( const SymmetricEigenVectorAnalysisFunction & ) const
     {
     return false;
@@ -60,7 +66,16 @@ public:
     {
     TOutput      eigenValues;
     TMatrix eigenVectorMatrix;
-    m_Calculator.ComputeEigenValuesAndVectors( x, eigenValues, eigenVectorMatrix );
+    if( m_UseClosedFormSolver )
+      {
+      m_Calculator3x3.ComputeEigenValuesAndVectors( x, eigenValues,
+                                                    eigenVectorMatrix );
+      }
+    else
+      {
+      m_Calculator.ComputeEigenValuesAndVectors( x, eigenValues,
+                                                 eigenVectorMatrix );
+      }
     return eigenVectorMatrix;
     }
 
@@ -70,6 +85,21 @@ public:
     m_Calculator.SetDimension(n);
     }
 
+  /** Use the closed-form 3x3 solver. The dimension must be 3. */
+  void SetUseClosedFormSolver( bool useClosedForm )
+    {
+    if( useClosedForm && m_Calculator.GetDimension() != 3 )
+      {
+      itkGenericExceptionMacro(
+        << "The closed-form solver only handles 3x3 matrices" );
+      }
+    m_UseClosedFormSolver = useClosedForm;
+    }
+  bool GetUseClosedFormSolver() const
+    {
+    return m_UseClosedFormSolver;
+    }
+
   /** Typdedefs to order eigen values. 
    * OrderByValue:      lambda_1 < lambda_2 < ....
    * OrderByMagnitude:  |lambda_1| < |lambda_2| < .....
@@ -87,15 +117,19 @@ public:
     if( order == OrderByMagnitude )
       {
       m_Calculator.SetOrderEigenMagnitudes( true );
+      m_Calculator3x3.SetOrderEigenMagnitudes( true );
       }
     else if( order == DoNotOrder )
       {
       m_Calculator.SetOrderEigenValues( false );
+      m_Calculator3x3.SetOrderEigenValues( false );
       }
     }
 
 private:
-  CalculatorType m_Calculator;
+  CalculatorType    m_Calculator;
+  Calculator3x3Type m_Calculator3x3;
+  bool              m_UseClosedFormSolver;
 }; 
 
 }  // end namespace functor
@@ -160,6 +194,18 @@ public:
     this->GetFunctor().SetDimension(p);
     }
 
+  /** Use the closed-form solver for 3x3 tensors instead of the iterative
+   * QL method. SetDimension( 3 ) must be called first. */
+  void SetUseClosedFormSolver( bool useClosedForm )
+    {
+    this->GetFunctor().SetUseClosedFormSolver( useClosedForm );
+    this->Modified();
+    }
+  bool GetUseClosedFormSolver()
+    {
+    return this->GetFunctor().GetUseClosedFormSolver();
+    }
+
 protected:
   SymmetricEigenVectorAnalysisImageFilter() {};
   virtual ~SymmetricEigenVectorAnalysisImageFilter() {};